@@ -8,11 +8,10 @@
 #define errormessage(x) errormessage_(x, __FILE__, __LINE__)
 
 /*
- * Create an account given a name and balance.
- * insession is initialized to 0.
+ * Create an account.
  */
 Account *
-accountcreate( char * name )
+accountcreate( void )
 {
 	Account *	account;
 	if ( (account = (Account *)malloc(sizeof(Account))) == NULL )
@@ -21,13 +20,119 @@ accountcreate( char * name )
 	}
 	else
 	{
-		strncpy(account->accountname, name, 100);
-		account->currentbalance = 0; 
-		account->insession = 0;
+		account->nameoffset = 0;
 	}
 	return account;
 }
 
+/*
+ * Initializes an account slot in the shared bank with the offset of its
+ * name and its session queue.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+accountinit( Account * account, size_t nameoffset )
+{
+	account->nameoffset = nameoffset;
+	if ( sessiongate_init( &account->clientsession ) != 0 )
+	{
+		errormessage("sessiongate_init() failed");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Atomically adds amount cents to an account balance unless the balance
+ * would overflow.
+ *
+ * Returns 0 on success, -3 if the credit would overflow.
+ */
+int
+accountcredit( int64_t * currentbalance, int64_t amount, int64_t * balance )
+{
+	*balance = __atomic_load_n( currentbalance, __ATOMIC_RELAXED );
+	do
+	{
+		if ( *balance > INT64_MAX - amount )
+		{
+			return -3;
+		}
+	} while ( !__atomic_compare_exchange_n( currentbalance, balance, *balance + amount,
+			1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED ) );
+	*balance += amount;
+	return 0;
+}
+
+/*
+ * Atomically subtracts amount cents from an account balance if the
+ * balance covers it.
+ *
+ * Returns 0 on success, -2 for insufficient funds.
+ */
+int
+accountdebit( int64_t * currentbalance, int64_t amount, int64_t * balance )
+{
+	*balance = __atomic_load_n( currentbalance, __ATOMIC_RELAXED );
+	do
+	{
+		if ( amount > *balance )
+		{
+			return -2;
+		}
+	} while ( !__atomic_compare_exchange_n( currentbalance, balance, *balance - amount,
+			1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED ) );
+	*balance -= amount;
+	return 0;
+}
+
+/*
+ * Applies n signed amounts, credits positive and debits negative, to the
+ * account balance in order with one compare-and-swap.  results[i] is set
+ * to 0 if amount i was applied, -2 if the running balance did not cover
+ * it, -3 if it would overflow the running balance.  With atomic set and
+ * any amount failing, nothing is applied.
+ *
+ * Returns the number of amounts applied and sets *balance to the new
+ * balance.
+ */
+int
+accountbatch( int64_t * currentbalance, const int64_t * amounts, int n, int atomic, int * results, int64_t * balance )
+{
+	int64_t		current;
+	int		i, applied;
+
+	current = __atomic_load_n( currentbalance, __ATOMIC_RELAXED );
+	do
+	{
+		for ( *balance = current, applied = 0, i = 0; i < n; i++ )
+		{
+			if ( amounts[i] < 0 && -amounts[i] > *balance )
+			{
+				results[i] = -2;
+			}
+			else if ( amounts[i] > 0 && *balance > INT64_MAX - amounts[i] )
+			{
+				results[i] = -3;
+			}
+			else
+			{
+				*balance += amounts[i];
+				results[i] = 0;
+				applied++;
+			}
+		}
+		if ( atomic && applied != n )
+		{
+			*balance = current;
+			return 0;
+		}
+	} while ( !__atomic_compare_exchange_n( currentbalance, &current, *balance,
+			1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED ) );
+	return applied;
+}
+
 /*
  * Destroy and free the memory of a given account.
  */
@@ -38,12 +143,13 @@ accountdestroy( Account * account )
 }
 
 /*
- * Prints the information regarding the account.
+ * Prints the information regarding the account, which has the given
+ * name, balance and session state.
  */
 void
-accountprint( Account * account )
+accountprint( Account * account, const char * name, int64_t currentbalance, int insession )
 {
-	char *		insession;
+	char		balance[AMOUNT_STRLEN];
 	if ( account == NULL )
 	{
 		errormessage("NULL Account");
@@ -51,18 +157,10 @@ accountprint( Account * account )
 	}
 	else
 	{
-		if ( account->insession)
-		{
-			insession = "IN SERVICE";	
-		}
-		else
-		{
-			insession = "NOT IN SERVICE";
-		}
 		printf("-----------------------------------------------------\n");
-		printf("Account name    -- %s\n", account->accountname);
-		printf("Current balance -- %.2f\n", account->currentbalance);
-		printf("Session status  -- %s\n", insession);
+		printf("Account name    -- %s\n", name);
+		printf("Current balance -- %s\n", formatamount( currentbalance, balance ));
+		printf("Session status  -- %s\n", insession ? "IN SERVICE" : "NOT IN SERVICE");
 		printf("-----------------------------------------------------\n");
 	}
 }
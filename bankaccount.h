@@ -5,26 +5,93 @@
  */
 #include <stdlib.h>
 #include <pthread.h>
+#include "banklock.h"
+#include "bankamount.h"
+
+/*
+ * Longest account name kept, in bytes.  Longer names are cut.
+ */
+#define ACCOUNT_NAMEMAX		99
 
 /*
  * A struct representing a bank account
+ *
+ * Only the session queue of an account and where to find its name live
+ * here.  In
+ * the shared bank the name is kept in the name arena, see bankarena.c,
+ * and the balance and the other state written by every transaction in an
+ * AccountState record, see bankstore.c.
  */
 struct Account_ {
-	char			accountname[100];
-	float			currentbalance;
-	unsigned int		insession:1;	
-	pthread_mutex_t		clientsession_mutex;
-	pthread_mutex_t		updateinfo_mutex;
+	size_t			nameoffset;
+	SessionGate		clientsession;
 };
 
 typedef struct Account_ Account;
 
 /*
- * Create an account given a name and balance.
- * insession is initialized to 0.
+ * The hot state of an account in the shared bank: everything a credit or
+ * debit reads or writes.  There is no lock word: credits and debits update
+ * the balance with compare-and-swap alone.  saved and version belong to
+ * the running snapshot, see banksnapshot.c; flags are ACCOUNT_ flags.
+ */
+struct AccountState_ {
+	int64_t			balance;
+	int64_t			saved;
+	uint32_t		version;
+	uint8_t			flags;
+};
+
+typedef struct AccountState_ AccountState;
+
+/*
+ * Create an account.
  */
 Account *
-accountcreate( char * name );
+accountcreate( void );
+
+/*
+ * Initializes an account slot in the shared bank with the offset of its
+ * name in the name arena and its locks.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+accountinit( Account * account, size_t nameoffset );
+
+/*
+ * Atomically adds amount cents to an account balance unless the balance
+ * would overflow.  The check and the addition are one compare-and-swap.
+ *
+ * Returns 0 and sets *balance to the new balance on success, -3 and sets
+ * *balance to the current balance if the credit would overflow.
+ */
+int
+accountcredit( int64_t * currentbalance, int64_t amount, int64_t * balance );
+
+/*
+ * Atomically subtracts amount cents from an account balance if the
+ * balance covers it.  The funds check and the subtraction are one
+ * compare-and-swap, so no lock is needed.
+ *
+ * Returns 0 and sets *balance to the new balance on success, -2 and sets
+ * *balance to the current balance for insufficient funds.
+ */
+int
+accountdebit( int64_t * currentbalance, int64_t amount, int64_t * balance );
+
+/*
+ * Applies n signed amounts, credits positive and debits negative, to the
+ * account balance in order with one compare-and-swap.  results[i] is set
+ * to 0 if amount i was applied, -2 if the running balance did not cover
+ * it, -3 if it would overflow the running balance.  With atomic set and
+ * any amount failing, nothing is applied.
+ *
+ * Returns the number of amounts applied and sets *balance to the new
+ * balance.
+ */
+int
+accountbatch( int64_t * currentbalance, const int64_t * amounts, int n, int atomic, int * results, int64_t * balance );
 
 /*
  * Destroy and free the memory of a given account.
@@ -33,9 +100,10 @@ void
 accountdestroy( Account * account );
 
 /*
- * Prints the information regarding the account.
+ * Prints the information regarding the account, which has the given
+ * name, balance and session state.
  */
 void
-accountprint( Account * account );
+accountprint( Account * account, const char * name, int64_t currentbalance, int insession );
 #endif
 
@@ -0,0 +1,77 @@
+/*
+ * bankamount.c
+ * Authors:	Emmanuel Baah
+ * 		Yuk Yan
+ *
+ * Exact conversion between decimal dollar strings and int64_t cents.
+ */
+#include "bankamount.h"
+
+/*
+ * Parses a decimal amount exactly into cents.
+ *
+ * Returns 0 on success, -1 if text is not a valid amount.
+ */
+int
+parseamount( const char * text, int64_t * amount )
+{
+	int64_t		value, unit;
+	int		negative, digits;
+
+	while ( *text == ' ' || *text == '\t' )
+	{
+		text++;
+	}
+	negative = *text == '-';
+	if ( *text == '-' || *text == '+' )
+	{
+		text++;
+	}
+	value = 0;
+	for ( digits = 0; *text >= '0' && *text <= '9'; text++, digits++ )
+	{
+		if ( (value = value * 10 + (*text - '0')) > AMOUNT_MAX / AMOUNT_SCALE )
+		{
+			return -1;
+		}
+	}
+	value *= AMOUNT_SCALE;
+	if ( *text == '.' )
+	{
+		for ( text++, unit = AMOUNT_SCALE; *text >= '0' && *text <= '9'; text++, digits++ )
+		{
+			if ( (unit /= 10) == 0 )
+			{
+				/* Finer than a cent */
+				return -1;
+			}
+			value += (*text - '0') * unit;
+		}
+	}
+	while ( *text == ' ' || *text == '\t' || *text == '\r' || *text == '\n' )
+	{
+		text++;
+	}
+	if ( digits == 0 || *text != '\0' || value > AMOUNT_MAX )
+	{
+		return -1;
+	}
+	*amount = negative ? -value : value;
+	return 0;
+}
+
+/*
+ * Formats an amount of cents as dollars with two decimals.
+ *
+ * Returns buff.
+ */
+char *
+formatamount( int64_t amount, char * buff )
+{
+	uint64_t	magnitude;
+
+	magnitude = amount < 0 ? -(uint64_t) amount : (uint64_t) amount;
+	snprintf(buff, AMOUNT_STRLEN, "%s%llu.%02llu", amount < 0 ? "-" : "",
+		(unsigned long long) (magnitude / AMOUNT_SCALE), (unsigned long long) (magnitude % AMOUNT_SCALE));
+	return buff;
+}
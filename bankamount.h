@@ -0,0 +1,42 @@
+#ifndef BANKAMOUNT_H
+#define BANKAMOUNT_H
+/*
+ * bankamount.h
+ */
+#include <stdint.h>
+
+/*
+ * Balances and amounts are int64_t counts of cents.
+ */
+#define AMOUNT_SCALE		100
+
+/*
+ * Largest amount accepted in one command, in cents.  Keeps every balance
+ * far from int64_t overflow.
+ */
+#define AMOUNT_MAX		((int64_t) 100000000000000000LL)
+
+/*
+ * Room for any formatted amount, including sign and NUL.
+ */
+#define AMOUNT_STRLEN		32
+
+/*
+ * Parses a decimal amount such as "10", "10.5" or "-3.25" exactly into
+ * cents.  Surrounding whitespace is ignored; more than two decimals,
+ * exponents or anything else are rejected.
+ *
+ * Returns 0 on success, -1 if text is not a valid amount.
+ */
+int
+parseamount( const char * text, int64_t * amount );
+
+/*
+ * Formats an amount of cents as dollars with two decimals into buff, which
+ * must hold AMOUNT_STRLEN characters.
+ *
+ * Returns buff.
+ */
+char *
+formatamount( int64_t amount, char * buff );
+#endif
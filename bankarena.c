@@ -0,0 +1,83 @@
+/*
+ * bankarena.c
+ * Authors:	Emmanuel Baah
+ * 		Yuk Yan
+ *
+ * Append-only arena of account names inside the shared bank.  Each name is
+ * stored once as a length prefixed entry, with its hash, and an Account
+ * refers to it by offset from the start of the arena, so accounts do not
+ * carry a fixed size name buffer.  Index lookups compare the hash and the
+ * length before looking at the bytes.
+ *
+ * Entries are only appended, under bankmutex, and are written before the
+ * index slot that makes their account findable is published, so other
+ * processes read them without a lock.  Space is reserved for the longest
+ * name of every account; only the part in use is backed by memory (or
+ * disk, bankdata being sparse) and copied into snapshots.
+ */
+#include "bankarena.h"
+
+#define BANKARENA(bank)		((char *) (bank) + (bank)->arenaoffset)
+
+/*
+ * Returns the number of bytes reserved for the names of maxaccounts
+ * accounts.
+ */
+size_t
+bankarena_reserve( int maxaccounts )
+{
+	return (size_t) maxaccounts * BANKNAME_BYTES(ACCOUNT_NAMEMAX);
+}
+
+/*
+ * Appends name to the arena of the bank.
+ *
+ * Returns 0 and sets *offset on success, -1 if the name is too long or
+ * the arena is full.
+ */
+int
+bankarena_add( Bank * bank, const char * name, size_t * offset )
+{
+	BankName	* entry;
+	size_t		length;
+	uint32_t	hash;
+
+	hash = bankhash( name, &length );
+	if ( length > ACCOUNT_NAMEMAX )
+	{
+		errormessage("Account name is too long");
+		return -1;
+	}
+	if ( bank->arenaused + BANKNAME_BYTES(length) > bank->arenasize )
+	{
+		errormessage("Name arena is full");
+		return -1;
+	}
+	*offset = bank->arenaused;
+	entry = bankarena_entry( bank, *offset );
+	entry->hash = hash;
+	entry->length = length;
+	memcpy(entry->name, name, length);
+	entry->name[length] = '\0';
+	flushmark( entry, BANKNAME_BYTES(length) );
+	__atomic_store_n( &bank->arenaused, *offset + BANKNAME_BYTES(length), __ATOMIC_RELEASE );
+	return 0;
+}
+
+/*
+ * Returns the arena entry at the given offset.
+ */
+BankName *
+bankarena_entry( Bank * bank, size_t offset )
+{
+	return (BankName *) (BANKARENA(bank) + offset);
+}
+
+/*
+ * Returns the name of the account with the given ID.
+ */
+const char *
+bankname( Bank * bank, int id )
+{
+	return bankarena_entry( bank, bankaccount( bank, id )->nameoffset )->name;
+}
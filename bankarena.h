@@ -0,0 +1,56 @@
+#ifndef BANKARENA_H
+#define BANKARENA_H
+/*
+ * bankarena.h
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * An account name in the arena: its hash, its length and the name itself,
+ * NUL terminated.  Entries are 4 byte aligned.
+ */
+struct BankName_ {
+	uint32_t		hash;
+	uint8_t			length;
+	char			name[];
+};
+typedef struct BankName_ BankName;
+
+/*
+ * Size of the arena entry of a name of length bytes.
+ */
+#define BANKNAME_BYTES(length)	((offsetof(BankName, name) + (length) + 1 + 3) & ~(size_t) 3)
+
+struct Bank_;
+
+/*
+ * Returns the number of bytes reserved for the names of maxaccounts
+ * accounts: room for every one of them to have the longest name, so the
+ * arena never fills before the bank does.
+ */
+size_t
+bankarena_reserve( int maxaccounts );
+
+/*
+ * Appends name to the arena of the bank.  Must be called with bankmutex
+ * held.
+ *
+ * Returns 0 and sets *offset to the offset of the entry on success, -1 if
+ * the name is longer than ACCOUNT_NAMEMAX or the arena is full.
+ */
+int
+bankarena_add( struct Bank_ * bank, const char * name, size_t * offset );
+
+/*
+ * Returns the arena entry at the given offset.
+ */
+BankName *
+bankarena_entry( struct Bank_ * bank, size_t offset );
+
+/*
+ * Returns the name of the account with the given ID.
+ */
+const char *
+bankname( struct Bank_ * bank, int id );
+#endif
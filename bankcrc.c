@@ -0,0 +1,82 @@
+/*
+ * bankcrc.c
+ * Authors:	Emmanuel Baah
+ * 		Yuk Yan
+ *
+ * CRC32C for the log records and the bankdata checksums.  x86 CPUs with
+ * SSE4.2 compute it with the crc32 instruction, eight bytes at a time;
+ * everything else uses a lookup table.
+ */
+#include "bankcrc.h"
+
+static uint32_t		bankcrctable[256];
+static pthread_once_t	bankcrconce = PTHREAD_ONCE_INIT;
+static int		bankcrchardware;
+
+/*
+ * Fills the lookup table and checks for the crc32 instruction.
+ */
+static void
+bankcrcinit( void )
+{
+	uint32_t	crc;
+	int		i, j;
+
+	for ( i = 0; i < 256; i++ )
+	{
+		for ( crc = i, j = 0; j < 8; j++ )
+		{
+			crc = crc & 1 ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+		}
+		bankcrctable[i] = crc;
+	}
+#if defined(__x86_64__)
+	bankcrchardware = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+#if defined(__x86_64__)
+/*
+ * CRC32C with the SSE4.2 crc32 instruction.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t
+bankcrcsse42( uint32_t crc, const unsigned char * cp, size_t length )
+{
+	uint64_t	word;
+
+	for ( ; length >= 8; length -= 8, cp += 8 )
+	{
+		memcpy(&word, cp, sizeof(word));
+		crc = (uint32_t) __builtin_ia32_crc32di( crc, word );
+	}
+	for ( ; length > 0; length--, cp++ )
+	{
+		crc = __builtin_ia32_crc32qi( crc, *cp );
+	}
+	return crc;
+}
+#endif
+
+/*
+ * Returns the CRC32C of length bytes at data, continuing crc.
+ */
+uint32_t
+bankcrc( uint32_t crc, const void * data, size_t length )
+{
+	const unsigned char	* cp;
+
+	pthread_once( &bankcrconce, bankcrcinit );
+	crc = ~crc;
+#if defined(__x86_64__)
+	if ( bankcrchardware )
+	{
+		return ~bankcrcsse42( crc, data, length );
+	}
+#endif
+	for ( cp = data; length > 0; length--, cp++ )
+	{
+		crc = bankcrctable[(crc ^ *cp) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
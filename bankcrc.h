@@ -0,0 +1,15 @@
+#ifndef BANKCRC_H
+#define BANKCRC_H
+/*
+ * bankcrc.h
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Returns the CRC32C (Castagnoli) of length bytes at data, continuing a
+ * crc returned by an earlier call.  Start with a crc of 0.
+ */
+uint32_t
+bankcrc( uint32_t crc, const void * data, size_t length );
+#endif
@@ -0,0 +1,98 @@
+/*
+ * bankdirty.c
+ * Authors:	Emmanuel Baah
+ * 		Yuk Yan
+ *
+ * Changed account tracking for the periodic report.  Sessions set a bit
+ * per account whose balance or session state they change, or that they
+ * open, in a bitmap shared by every server process, and the report prints
+ * only the marked accounts.  Whole words of unchanged accounts are
+ * skipped, so a report costs little more than the accounts it prints.
+ *
+ * As with dirty pages (see bankflush.c), an account is marked after it is
+ * changed and its bit is cleared before it is read, so a change racing
+ * with the report is at worst reported twice.
+ */
+#include "bankdirty.h"
+
+static int		dirtyaccounts;
+static uint64_t		* dirtymap;
+
+/*
+ * Starts tracking the changed accounts of a bank of up to maxaccounts
+ * accounts.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+dirtyinit( int maxaccounts )
+{
+	if ( (dirtymap = mmap(0, (maxaccounts + 63) / 64 * sizeof(uint64_t), PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED )
+	{
+		errormessage("mmap() failed");
+		dirtymap = NULL;
+		return -1;
+	}
+	dirtyaccounts = maxaccounts;
+	return 0;
+}
+
+/*
+ * Marks account id changed.
+ */
+void
+dirtymark( int id )
+{
+	uint64_t	bit;
+
+	if ( dirtymap == NULL || id < 0 || id >= dirtyaccounts )
+	{
+		return;
+	}
+	bit = (uint64_t) 1 << (id % 64);
+	/* A busy account is usually marked already, do not bounce the line */
+	if ( (__atomic_load_n( &dirtymap[id / 64], __ATOMIC_RELAXED ) & bit) == 0 )
+	{
+		__atomic_fetch_or( &dirtymap[id / 64], bit, __ATOMIC_RELEASE );
+	}
+}
+
+/*
+ * Collects and clears the marks of the first n accounts.
+ *
+ * Returns the number of IDs stored into ids.
+ */
+int
+dirtytake( int * ids, int n )
+{
+	uint64_t	bits, keep;
+	int		word, id, count;
+
+	if ( dirtymap == NULL )
+	{
+		return 0;
+	}
+	if ( n > dirtyaccounts )
+	{
+		n = dirtyaccounts;
+	}
+	for ( count = 0, word = 0; word < (n + 63) / 64; word++ )
+	{
+		if ( __atomic_load_n( &dirtymap[word], __ATOMIC_RELAXED ) == 0 )
+		{
+			continue;
+		}
+		/* Leave the marks of accounts past n for the next report */
+		keep = n - word * 64 < 64 ? ~(uint64_t) 0 << (n - word * 64) : 0;
+		bits = __atomic_fetch_and( &dirtymap[word], keep, __ATOMIC_ACQ_REL ) & ~keep;
+		for ( id = word * 64; bits != 0; id++, bits >>= 1 )
+		{
+			if ( bits & 1 )
+			{
+				ids[count++] = id;
+			}
+		}
+	}
+	return count;
+}
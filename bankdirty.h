@@ -0,0 +1,34 @@
+#ifndef BANKDIRTY_H
+#define BANKDIRTY_H
+/*
+ * bankdirty.h
+ */
+#include <stdint.h>
+#include <sys/mman.h>
+
+/*
+ * Starts tracking the changed accounts of a bank of up to maxaccounts
+ * accounts.  The tracking state is shared with processes fork()ed
+ * afterwards.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+dirtyinit( int maxaccounts );
+
+/*
+ * Marks account id changed.  Must be called after the change is made.
+ * Does nothing if no bank is tracked.
+ */
+void
+dirtymark( int id );
+
+/*
+ * Stores the IDs of the changed accounts among the first n into ids, in
+ * order, and clears their marks.  ids must have room for n IDs.
+ *
+ * Returns the number of IDs stored.
+ */
+int
+dirtytake( int * ids, int n );
+#endif
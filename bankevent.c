@@ -0,0 +1,535 @@
+/*
+ * bankevent.c
+ * Authors:	Emmanuel Baah
+ * 		Yuk Yan
+ *
+ * Listening socket setup, the epoll event loop and the pre-fork()ed worker
+ * pool.  In event loop mode the server does not fork() per connection;
+ * every client is a small Session that is fed whenever its socket becomes
+ * readable.  Client sockets are non-blocking: replies a client does not
+ * read yet wait in its session's backlog and go out when its socket
+ * becomes writable, so one slow client never holds up the loop.
+ */
+#include "bankevent.h"
+
+static Session		* sessions;
+static struct timespec	retried;
+volatile sig_atomic_t	serverstop;
+
+/*
+ * Initializes the addrinfo hints for a passive TCP socket.
+ */
+void
+init_addrinfo( struct addrinfo * aiptr )
+{
+	(*aiptr).ai_flags = AI_PASSIVE;
+	(*aiptr).ai_family = AF_INET;
+	(*aiptr).ai_socktype = SOCK_STREAM;
+	(*aiptr).ai_protocol = 0;
+	(*aiptr).ai_addrlen = 0;
+	(*aiptr).ai_canonname = NULL;
+	(*aiptr).ai_next = NULL;
+}
+
+/*
+ * Creates a socket bound to the given port and listening.  With reuseport
+ * set, every caller gets its own listener on the same port (SO_REUSEPORT)
+ * and the kernel balances connections between them.
+ *
+ * Returns the socket descriptor, -1 on error.
+ */
+int
+init_listener( const char * port, int reuseport )
+{
+	struct addrinfo		hints,
+				* result;
+	int			sockfd, on;
+
+	init_addrinfo(&hints);
+	on = 1;
+
+	if ( getaddrinfo(NULL, port, &hints, &result) != 0 )
+	{
+		errormessage("getaddrinfo() failed");
+		return -1;
+	}
+	else if ( (sockfd = socket(result->ai_family, result->ai_socktype, result->ai_protocol)) == -1 )
+	{
+		errormessage("socket() failed");
+		freeaddrinfo(result);
+		return -1;
+	}
+	else if ( setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 )
+	{
+		errormessage("setsockopt() failed");
+	}
+	else if ( reuseport && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0 )
+	{
+		errormessage("setsockopt() failed");
+	}
+	else if ( bind(sockfd, result->ai_addr, result->ai_addrlen) != 0 )
+	{
+		errormessage("bind() failed");
+	}
+	else if ( listen(sockfd, 100) != 0 )
+	{
+		errormessage("listen() failed");
+	}
+	else
+	{
+		freeaddrinfo(result);
+		return sockfd;
+	}
+	freeaddrinfo(result);
+	close(sockfd);
+	return -1;
+}
+
+/*
+ * Links a session into the list of live sessions.
+ */
+static void
+eventlink( Session * session )
+{
+	session->prev = NULL;
+	session->next = sessions;
+	if ( sessions != NULL )
+	{
+		sessions->prev = session;
+	}
+	sessions = session;
+}
+
+/*
+ * Closes a session and frees it.
+ */
+static void
+eventclose( int epfd, Session * session )
+{
+	epoll_ctl(epfd, EPOLL_CTL_DEL, session->sd, NULL);
+	if ( session->prev != NULL )
+	{
+		session->prev->next = session->next;
+	}
+	else
+	{
+		sessions = session->next;
+	}
+	if ( session->next != NULL )
+	{
+		session->next->prev = session->prev;
+	}
+	logevent( LOG_CLOSED, 0, 0, NULL, 0 );
+	sessionclose( session );
+	free( session );
+}
+
+/*
+ * Updates the events watched for a session.  A session parked in start
+ * is not read until it gets its account, so its input waits in the
+ * socket; neither is one whose backlog is full.  A session with a backlog
+ * waits for its socket to become writable.
+ */
+static void
+eventwatch( int epfd, Session * session )
+{
+	struct epoll_event	event;
+
+	event.events = 0;
+	if ( session->waitid == -1 && session->backloglen < SESSION_BACKLOGMAX )
+	{
+		event.events |= EPOLLIN;
+	}
+	if ( session->backloglen > 0 )
+	{
+		event.events |= EPOLLOUT;
+	}
+	if ( event.events == session->events )
+	{
+		return;
+	}
+	event.data.ptr = session;
+	if ( epoll_ctl(epfd, EPOLL_CTL_MOD, session->sd, &event) != 0 )
+	{
+		errormessage("epoll_ctl() failed");
+		return;
+	}
+	session->events = event.events;
+}
+
+/*
+ * Accepts every pending connection on the listening socket.
+ */
+static void
+eventaccept( int epfd, int sockfd )
+{
+	struct epoll_event	event;
+	Session			* session;
+	int			fd;
+
+	while ( (fd = accept4(sockfd, NULL, NULL, SOCK_NONBLOCK)) != -1 )
+	{
+		if ( (session = (Session *) malloc(sizeof(Session))) == NULL )
+		{
+			errormessage("malloc() failed");
+			close(fd);
+			continue;
+		}
+		sessioninit( session, fd, 0 );
+		session->events = event.events = EPOLLIN;
+		event.data.ptr = session;
+		if ( epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event) != 0 )
+		{
+			errormessage("epoll_ctl() failed");
+			close(fd);
+			free(session);
+			continue;
+		}
+		eventlink( session );
+		logevent( LOG_ACCEPTED, 0, 0, NULL, 0 );
+		sessionprompt( session );
+		if ( sessionflush( session ) != 0 )
+		{
+			eventclose( epfd, session );
+			continue;
+		}
+		eventwatch( epfd, session );
+	}
+	if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+	{
+		errormessage("accept() failed");
+	}
+}
+
+/*
+ * Sends the replies buffered by every session.  The first flush commits
+ * the log for all of them.  Backlogs are left for their sockets to become
+ * writable.
+ */
+static void
+eventflush( int epfd )
+{
+	Session		* session, * next;
+
+	for ( session = sessions; session != NULL; session = next )
+	{
+		next = session->next;
+		if ( session->outlen == 0 )
+		{
+			continue;
+		}
+		else if ( sessionflush( session ) != 0 )
+		{
+			eventclose( epfd, session );
+		}
+		else
+		{
+			eventwatch( epfd, session );
+		}
+	}
+}
+
+/*
+ * Returns how long the loop may sleep, in milliseconds: until the nearest
+ * start deadline of a parked session or until EVENT_REAP_MS after the last
+ * eventretry() so that parked sessions notice a dead holder, or -1 when no
+ * session is parked.  0 means a retry is due now.
+ */
+static int
+eventtimeout( void )
+{
+	Session		* session;
+	struct timespec	now;
+	int64_t		timeout, left;
+
+	for ( timeout = -1, session = sessions; session != NULL; session = session->next )
+	{
+		if ( session->waitid == -1 )
+		{
+			continue;
+		}
+		else if ( timeout == -1 )
+		{
+			clock_gettime( CLOCK_MONOTONIC, &now );
+			timeout = EVENT_REAP_MS - ((now.tv_sec - retried.tv_sec) * 1000 + (now.tv_nsec - retried.tv_nsec) / 1000000);
+			timeout = timeout < 0 ? 0 : timeout;
+		}
+		if ( session->deadline.tv_sec != 0 )
+		{
+			left = (session->deadline.tv_sec - now.tv_sec) * 1000 + (session->deadline.tv_nsec - now.tv_nsec + 999999) / 1000000;
+			timeout = left < 0 ? 0 : left < timeout ? left : timeout;
+		}
+	}
+	return (int) timeout;
+}
+
+/*
+ * Retries every session parked in start.
+ */
+static void
+eventretry( int epfd )
+{
+	Session		* session, * next;
+
+	clock_gettime( CLOCK_MONOTONIC, &retried );
+	for ( session = sessions; session != NULL; session = next )
+	{
+		next = session->next;
+		if ( session->waitid != -1 && sessionretry( session ) != SESSION_WAIT )
+		{
+			if ( sessiondrain( session ) == SESSION_EXIT )
+			{
+				eventclose( epfd, session );
+			}
+			else
+			{
+				eventwatch( epfd, session );
+			}
+		}
+	}
+}
+
+/*
+ * Serves every connection accepted on sockfd from this one process.
+ *
+ * Each client is a Session driven by epoll readiness events.  SIGINT is
+ * only let in while waiting for events.
+ *
+ * Returns 0 once serverstop is set, -1 on error.
+ */
+int
+eventloop( int sockfd )
+{
+	struct epoll_event	event,
+				events[EVENT_MAX];
+	Session			* session;
+	sigset_t		waitmask;
+	int			epfd, n, i, woken;
+
+	if ( fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL) | O_NONBLOCK) == -1 )
+	{
+		errormessage("fcntl() failed");
+		return -1;
+	}
+	else if ( sessiongate_wakeinit() != 0 )
+	{
+		return -1;
+	}
+	else if ( (epfd = epoll_create1(0)) == -1 )
+	{
+		errormessage("epoll_create1() failed");
+		return -1;
+	}
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+	if ( epoll_ctl(epfd, EPOLL_CTL_ADD, sockfd, &event) != 0 )
+	{
+		errormessage("epoll_ctl() failed");
+		close(epfd);
+		return -1;
+	}
+	/* Edge triggered, see sessiongate_wakefd */
+	event.events = EPOLLIN | EPOLLET;
+	event.data.ptr = &sessiongate_wakefd;
+	if ( epoll_ctl(epfd, EPOLL_CTL_ADD, sessiongate_wakefd, &event) != 0 )
+	{
+		errormessage("epoll_ctl() failed");
+		close(epfd);
+		return -1;
+	}
+
+	pthread_sigmask( SIG_BLOCK, NULL, &waitmask );
+	sigdelset( &waitmask, SIGINT );
+
+	printf("[PID - %d]: Event loop waiting for connections...\n", getpid());
+	while ( !serverstop )
+	{
+		if ( (n = epoll_pwait(epfd, events, EVENT_MAX, eventtimeout(), &waitmask)) == -1 )
+		{
+			if ( errno == EINTR )
+			{
+				continue;
+			}
+			errormessage("epoll_pwait() failed");
+			close(epfd);
+			return -1;
+		}
+		for ( woken = n == 0, i = 0; i < n; i++ )
+		{
+			if ( (session = events[i].data.ptr) == NULL )
+			{
+				eventaccept( epfd, sockfd );
+			}
+			else if ( events[i].data.ptr == &sessiongate_wakefd )
+			{
+				woken = 1;
+			}
+			else if ( (events[i].events & EPOLLOUT) && sessionflush( session ) != 0 )
+			{
+				eventclose( epfd, session );
+			}
+			else if ( (events[i].events & ~EPOLLOUT) != 0 && sessioninput( session ) == SESSION_EXIT )
+			{
+				eventclose( epfd, session );
+			}
+			else
+			{
+				eventwatch( epfd, session );
+			}
+		}
+		if ( woken || eventtimeout() == 0 )
+		{
+			/*
+			 * A gate passed a session on, or a deadline or reap is due.
+			 * Checked after every batch, traffic must not starve it.
+			 */
+			eventretry( epfd );
+		}
+		eventflush( epfd );
+	}
+	close(epfd);
+	return 0;
+}
+
+/*
+ * Forks one worker.  The worker opens its own listener and runs the event
+ * loop until it dies.
+ *
+ * Returns the worker PID in the parent, -1 on error.
+ */
+static pid_t
+workerspawn( const char * port, int worker )
+{
+	pid_t		pid;
+	int		sockfd;
+
+	if ( (pid = fork()) == -1 )
+	{
+		errormessage("fork() failed");
+		return -1;
+	}
+	else if ( pid == 0 )
+	/*** WORKER PROCESS ***/
+	{
+		/* Do not outlive the parent that restarts us */
+		prctl(PR_SET_PDEATHSIG, SIGTERM);
+		if ( (sockfd = init_listener( port, 1 )) == -1 )
+		{
+			errormessage("Worker failed to initialize listener");
+			_exit(1);
+		}
+		printf("[PID - %d]: Worker %d started\n", getpid(), worker);
+		eventloop( sockfd );
+		_exit(1);
+	}
+	return pid;
+}
+
+/*
+ * Forks nworkers long lived event loop workers, each accepting on its own
+ * SO_REUSEPORT listener, and restarts any worker that dies.  The bank stays
+ * mapped in this process so restarted workers inherit it.  On SIGINT the
+ * workers are stopped and reaped.
+ *
+ * Returns 0 on SIGINT, -1 on error.
+ */
+int
+workerpool( const char * port, int nworkers )
+{
+	struct sigaction	action;
+	struct timespec		reap;
+	sigset_t		interrupt;
+	pid_t			pids[WORKER_MAX];
+	time_t			started[WORKER_MAX];
+	pid_t			pid;
+	int			i, status;
+
+	if ( nworkers < 1 || nworkers > WORKER_MAX )
+	{
+		errormessage("Invalid number of workers");
+		return -1;
+	}
+
+	/* Every worker watches the same wake up eventfd */
+	if ( sessiongate_wakeinit() != 0 )
+	{
+		return -1;
+	}
+
+	/* Workers are reaped here, not by the SIGCHLD handler */
+	action.sa_flags = 0;
+	action.sa_handler = SIG_DFL;
+	sigemptyset( &action.sa_mask );
+	sigaction(SIGCHLD, &action, 0);
+
+	for ( i = 0; i < nworkers; i++ )
+	{
+		if ( (pids[i] = workerspawn( port, i )) == -1 )
+		{
+			return -1;
+		}
+		started[i] = time(NULL);
+	}
+
+	/*
+	 * SIGINT stays blocked and is taken here, between reaping the workers.
+	 * SIGCHLD cannot be waited for the same way, any thread may take it.
+	 */
+	sigemptyset( &interrupt );
+	sigaddset( &interrupt, SIGINT );
+	reap.tv_sec = 0;
+	reap.tv_nsec = WORKER_REAP_MS * 1000000L;
+	while ( 1 )
+	{
+		if ( serverstop )
+		{
+			for ( i = 0; i < nworkers; i++ )
+			{
+				kill(pids[i], SIGTERM);
+			}
+			while ( waitpid(-1, NULL, 0) != -1 || errno == EINTR );
+			return 0;
+		}
+		if ( (pid = waitpid(-1, &status, WNOHANG)) == 0 )
+		{
+			if ( sigtimedwait( &interrupt, NULL, &reap ) == SIGINT )
+			{
+				serverstop = 1;
+			}
+			continue;
+		}
+		else if ( pid == -1 )
+		{
+			if ( errno == EINTR )
+			{
+				continue;
+			}
+			errormessage("waitpid() failed");
+			return -1;
+		}
+		for ( i = 0; i < nworkers && pids[i] != pid; i++ );
+		if ( i == nworkers )
+		{
+			continue;
+		}
+		if ( WIFSIGNALED(status) )
+		{
+			printf("[PID - %d]: Worker %d [PID - %d] killed by signal %d, restarting\n", getpid(), i, pid, WTERMSIG(status));
+		}
+		else
+		{
+			printf("[PID - %d]: Worker %d [PID - %d] exited with status %d, restarting\n", getpid(), i, pid, WEXITSTATUS(status));
+		}
+		if ( time(NULL) - started[i] < 1 )
+		{
+			/* Dying as soon as it starts, do not spin */
+			sleep(1);
+		}
+		while ( (pids[i] = workerspawn( port, i )) == -1 )
+		{
+			sleep(1);
+		}
+		started[i] = time(NULL);
+	}
+	return 0;
+}
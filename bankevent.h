@@ -0,0 +1,63 @@
+#ifndef BANKEVENT_H
+#define BANKEVENT_H
+/*
+ * bankevent.h
+ */
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <time.h>
+
+#define EVENT_MAX		64
+#define EVENT_REAP_MS		1000
+#define WORKER_REAP_MS		100
+#define WORKER_MAX		256
+
+/*
+ * Set by the servers' SIGINT handler.  eventloop() and workerpool() return
+ * once it is set, so that the server shuts down outside the handler.
+ */
+extern volatile sig_atomic_t	serverstop;
+
+/*
+ * Initializes the addrinfo hints for a passive TCP socket.
+ */
+void
+init_addrinfo( struct addrinfo * aiptr );
+
+/*
+ * Creates a socket bound to the given port and listening.  With reuseport
+ * set, every caller gets its own listener on the same port (SO_REUSEPORT)
+ * and the kernel balances connections between them.
+ *
+ * Returns the socket descriptor, -1 on error.
+ */
+int
+init_listener( const char * port, int reuseport );
+
+/*
+ * Serves every connection accepted on sockfd from this one process.
+ *
+ * Each client is a Session driven by epoll readiness events.  SIGINT is
+ * only let in while waiting for events.
+ *
+ * Returns 0 once serverstop is set, -1 on error.
+ */
+int
+eventloop( int sockfd );
+
+/*
+ * Forks nworkers long lived event loop workers, each accepting on its own
+ * SO_REUSEPORT listener, and restarts any worker that dies.  The bank stays
+ * mapped in this process so restarted workers inherit it.  On SIGINT the
+ * workers are stopped and reaped.
+ *
+ * Returns 0 on SIGINT, -1 on error.
+ */
+int
+workerpool( const char * port, int nworkers );
+#endif
@@ -0,0 +1,134 @@
+/*
+ * bankflush.c
+ * Authors:	Emmanuel Baah
+ * 		Yuk Yan
+ *
+ * Dirty page tracking for the memory mapped bank.  Sessions set a bit per
+ * page they change in a bitmap shared by every server process, and the
+ * background flusher msync()s only the runs of marked pages, so sessions
+ * never wait for the disk themselves.
+ *
+ * A page is marked after it is written and its bit is cleared before it is
+ * synced, so a change racing with the flusher is at worst synced twice.
+ */
+#include "bankflush.h"
+
+static char		* flushbase;
+static size_t		flushpages;
+static size_t		flushpagesize;
+static uint64_t		* flushmap;
+
+/*
+ * Starts tracking dirty pages of the bytes long mapping at base.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+flushinit( void * base, size_t bytes )
+{
+	flushpagesize = sysconf(_SC_PAGESIZE);
+	flushpages = (bytes + flushpagesize - 1) / flushpagesize;
+	if ( (flushmap = mmap(0, (flushpages + 63) / 64 * sizeof(uint64_t), PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED )
+	{
+		errormessage("mmap() failed");
+		flushmap = NULL;
+		return -1;
+	}
+	flushbase = base;
+	return 0;
+}
+
+/*
+ * Marks the pages holding length bytes at addr dirty.
+ */
+void
+flushmark( const void * addr, size_t length )
+{
+	size_t		page, last;
+	uint64_t	bit;
+
+	if ( flushmap == NULL || length == 0 )
+	{
+		return;
+	}
+	page = ((const char *) addr - flushbase) / flushpagesize;
+	last = ((const char *) addr - flushbase + length - 1) / flushpagesize;
+	for ( ; page <= last; page++ )
+	{
+		bit = (uint64_t) 1 << (page % 64);
+		/* Most changes hit a page that is already dirty, do not bounce it */
+		if ( (__atomic_load_n( &flushmap[page / 64], __ATOMIC_RELAXED ) & bit) == 0 )
+		{
+			__atomic_fetch_or( &flushmap[page / 64], bit, __ATOMIC_RELEASE );
+		}
+	}
+}
+
+/*
+ * Syncs count pages starting at page.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+flushrun( size_t page, size_t count )
+{
+	if ( count > 0 && msync(flushbase + page * flushpagesize, count * flushpagesize, MS_SYNC) != 0 )
+	{
+		errormessage("msync() failed");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Writes every page marked dirty back with msync(), one call per run of
+ * consecutive dirty pages.
+ *
+ * Returns the number of pages written, -1 on error.
+ */
+int
+flushdirty( void )
+{
+	uint64_t	bits;
+	size_t		word, page, start, count;
+	int		written, rv;
+
+	if ( flushmap == NULL )
+	{
+		return 0;
+	}
+	written = rv = 0;
+	for ( start = count = 0, word = 0; word < (flushpages + 63) / 64; word++ )
+	{
+		if ( __atomic_load_n( &flushmap[word], __ATOMIC_RELAXED ) == 0 )
+		{
+			/* Nothing dirty here, only end the current run */
+			rv |= flushrun( start, count );
+			written += count;
+			count = 0;
+			continue;
+		}
+		bits = __atomic_exchange_n( &flushmap[word], 0, __ATOMIC_ACQ_REL );
+		for ( page = word * 64; page < (word + 1) * 64; page++, bits >>= 1 )
+		{
+			if ( bits & 1 )
+			{
+				if ( count == 0 )
+				{
+					start = page;
+				}
+				count++;
+			}
+			else if ( count > 0 )
+			{
+				rv |= flushrun( start, count );
+				written += count;
+				count = 0;
+			}
+		}
+	}
+	rv |= flushrun( start, count );
+	written += count;
+	return rv == 0 ? written : -1;
+}
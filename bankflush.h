@@ -0,0 +1,38 @@
+#ifndef BANKFLUSH_H
+#define BANKFLUSH_H
+/*
+ * bankflush.h
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+/*
+ * Default interval of the background flusher.
+ */
+#define FLUSH_INTERVAL_MS	100
+
+/*
+ * Starts tracking dirty pages of the bytes long mapping at base.  The
+ * tracking state is shared with processes fork()ed afterwards.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+flushinit( void * base, size_t bytes );
+
+/*
+ * Marks the pages holding length bytes at addr dirty.  Must be called
+ * after they are written.  Does nothing if no mapping is tracked.
+ */
+void
+flushmark( const void * addr, size_t length );
+
+/*
+ * Writes every page marked dirty back to its file with msync().
+ *
+ * Returns the number of pages written, -1 on error.
+ */
+int
+flushdirty( void );
+#endif
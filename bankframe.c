@@ -0,0 +1,83 @@
+/*
+ * bankframe.c
+ * Authors:	Emmanuel Baah
+ * 		Yuk Yan
+ *
+ * Encoding and decoding of the binary protocol frames.  Fields are copied
+ * out of the input buffer with memcpy() so frames need no alignment.
+ */
+#include "bankframe.h"
+
+/*
+ * Decodes the request frame at the start of buff.
+ *
+ * Returns the size of the frame, 0 if it is not complete yet, -1 if its
+ * length field is invalid.
+ */
+int
+frameparse( const char * buff, int length, Frame * frame )
+{
+	uint16_t	size;
+	uint32_t	id;
+	uint64_t	amount;
+
+	if ( length < 2 )
+	{
+		return 0;
+	}
+	memcpy(&size, buff, 2);
+	size = be16toh(size);
+	if ( size < FRAME_HEADER || size > FRAME_MAX )
+	{
+		return -1;
+	}
+	else if ( length < size )
+	{
+		return 0;
+	}
+	memcpy(&id, buff + 4, 4);
+	memcpy(&amount, buff + 8, 8);
+	frame->opcode = (unsigned char) buff[2];
+	frame->status = FRAME_OK;
+	frame->id = (int32_t) be32toh(id);
+	frame->amount = (int64_t) be64toh(amount);
+	memcpy(frame->name, buff + FRAME_HEADER, size - FRAME_HEADER);
+	frame->name[size - FRAME_HEADER] = '\0';
+	return size;
+}
+
+/*
+ * Returns the name of a status code.
+ */
+const char *
+framestatus( int status )
+{
+	static const char	* names[] = { "OK", "ERROR", "NOTFOUND", "EXISTS", "FULL", "INSESSION",
+					"NOSESSION", "FUNDS", "INVALID", "BUSY", "TIMEDOUT", "OVERFLOW" };
+
+	if ( status < 0 || status >= (int) (sizeof(names) / sizeof(names[0])) )
+	{
+		return "ERROR";
+	}
+	return names[status];
+}
+
+/*
+ * Encodes a reply frame into buff.
+ */
+void
+frameformat( const Frame * frame, char * buff )
+{
+	uint16_t	size;
+	uint32_t	id;
+	uint64_t	amount;
+
+	size = htobe16(FRAME_REPLY);
+	id = htobe32((uint32_t) frame->id);
+	amount = htobe64((uint64_t) frame->amount);
+	memcpy(buff, &size, 2);
+	buff[2] = frame->opcode;
+	buff[3] = frame->status;
+	memcpy(buff + 4, &id, 4);
+	memcpy(buff + 8, &amount, 8);
+}
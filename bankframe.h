@@ -0,0 +1,92 @@
+#ifndef BANKFRAME_H
+#define BANKFRAME_H
+/*
+ * bankframe.h
+ */
+#include <stdint.h>
+#include <endian.h>
+
+/*
+ * Binary protocol, entered with the text command "binary".  Every integer
+ * is big endian.
+ *
+ * Request:	uint16 length	whole frame, FRAME_HEADER plus the name
+ *		uint8  opcode	FRAME_OPEN ... FRAME_EXIT
+ *		uint8  reserved
+ *		int32  id	account id, -1 to use the name
+ *		int64  amount	cents; wait timeout in seconds for start
+ *		char   name[]	length - FRAME_HEADER bytes, not terminated
+ *
+ * Reply:	uint16 length	FRAME_REPLY
+ *		uint8  opcode	of the request
+ *		uint8  status	FRAME_OK or an error below
+ *		int32  id	account id, -1 if none
+ *		int64  amount	balance in cents after the operation
+ */
+#define FRAME_HEADER		16
+#define FRAME_NAMEMAX		99
+#define FRAME_MAX		(FRAME_HEADER + FRAME_NAMEMAX)
+#define FRAME_REPLY		16
+
+/*
+ * Opcodes, numbered as the COMMAND_ code of the text command plus one.
+ */
+#define FRAME_OPEN		1
+#define FRAME_START		2
+#define FRAME_CREDIT		3
+#define FRAME_DEBIT		4
+#define FRAME_BALANCE		5
+#define FRAME_FINISH		6
+#define FRAME_EXIT		7
+
+/*
+ * Reply status codes, named by framestatus() in machine mode.
+ */
+#define FRAME_OK		0
+#define FRAME_ERROR		1	/* unknown opcode or bad frame */
+#define FRAME_NOTFOUND		2
+#define FRAME_EXISTS		3
+#define FRAME_FULL		4
+#define FRAME_INSESSION		5
+#define FRAME_NOSESSION		6
+#define FRAME_FUNDS		7
+#define FRAME_INVALID		8	/* bad amount */
+#define FRAME_BUSY		9	/* too many clients waiting */
+#define FRAME_TIMEDOUT		10
+#define FRAME_OVERFLOW		11	/* credit would overflow the balance */
+
+/*
+ * A decoded request or reply.
+ */
+struct Frame_ {
+	int			opcode;
+	int			status;
+	int32_t			id;
+	int64_t			amount;
+	char			name[FRAME_NAMEMAX + 1];
+};
+
+typedef struct Frame_ Frame;
+
+/*
+ * Decodes the request frame at the start of buff, which holds length
+ * bytes.
+ *
+ * Returns the size of the frame, 0 if it is not complete yet, -1 if its
+ * length field is invalid.
+ */
+int
+frameparse( const char * buff, int length, Frame * frame );
+
+/*
+ * Returns the name of a status code, as used in machine mode replies.
+ */
+const char *
+framestatus( int status );
+
+/*
+ * Encodes a reply frame into buff, which must hold FRAME_REPLY bytes.
+ */
+void
+frameformat( const Frame * frame, char * buff );
+#endif
@@ -0,0 +1,99 @@
+/*
+ * bankindex.c
+ * Authors:	Emmanuel Baah
+ * 		Yuk Yan
+ *
+ * Open addressing hash index from account name to account ID.  The index
+ * lives inside the shared Bank, ahead of the accounts, and has indexsize
+ * slots: a power of two at least twice the maximum number of accounts, so
+ * probes stay short even in a full bank.  Each slot packs the
+ * name hash and ID + 1 into one 64 bit word (0 is an empty slot), so an
+ * insert is published with a single atomic store and lookups from other
+ * processes need no lock.  A lookup only compares the bytes of a name in
+ * the name arena once its hash and its length match.  Accounts are never removed, so a slot never
+ * changes once set.
+ */
+#include "bankindex.h"
+
+#define SLOT_HASH(slot)		((uint32_t) ((slot) >> 32))
+#define SLOT_ID(slot)		((int) ((slot) & 0xffffffff) - 1)
+#define BANKINDEX(bank)		((uint64_t *) ((char *) (bank) + (bank)->indexoffset))
+
+/*
+ * Returns the FNV-1a hash of an account name and sets *length.
+ */
+uint32_t
+bankhash( const char * name, size_t * length )
+{
+	uint32_t	hash;
+	size_t		i;
+
+	hash = 2166136261u;
+	for ( i = 0; name[i] != '\0'; i++ )
+	{
+		hash ^= (unsigned char) name[i];
+		hash *= 16777619u;
+	}
+	*length = i;
+	return hash;
+}
+
+/*
+ * Looks an account name up in the bank's index.
+ *
+ * Returns the ID (or index) of the account, -1 if not found.
+ */
+int
+bankindex_find( Bank * bank, const char * name )
+{
+	uint32_t	hash, mask, i, n;
+	uint64_t	* index, slot;
+	BankName	* entry;
+	size_t		length;
+
+	hash = bankhash( name, &length );
+	index = BANKINDEX(bank);
+	mask = bank->indexsize - 1;
+	for ( n = 0, i = hash & mask; n < bank->indexsize; n++, i = (i + 1) & mask )
+	{
+		if ( (slot = __atomic_load_n( &index[i], __ATOMIC_ACQUIRE )) == 0 )
+		{
+			return -1;
+		}
+		else if ( SLOT_HASH(slot) == hash )
+		{
+			entry = bankarena_entry( bank, bankaccount( bank, SLOT_ID(slot) )->nameoffset );
+			if ( entry->length == length && memcmp(entry->name, name, length) == 0 )
+			{
+				return SLOT_ID(slot);
+			}
+		}
+	}
+	return -1;
+}
+
+/*
+ * Adds the account with the given ID to the index.
+ *
+ * Returns 0 on success, -1 if the index is full.
+ */
+int
+bankindex_insert( Bank * bank, int id )
+{
+	uint32_t	hash, mask, i, n;
+	uint64_t	* index;
+
+	hash = bankarena_entry( bank, bankaccount( bank, id )->nameoffset )->hash;
+	index = BANKINDEX(bank);
+	mask = bank->indexsize - 1;
+	for ( n = 0, i = hash & mask; n < bank->indexsize; n++, i = (i + 1) & mask )
+	{
+		if ( index[i] == 0 )
+		{
+			__atomic_store_n( &index[i], ((uint64_t) hash << 32) | (uint32_t) (id + 1), __ATOMIC_RELEASE );
+			flushmark( &index[i], sizeof(index[i]) );
+			return 0;
+		}
+	}
+	return -1;
+}
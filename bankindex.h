@@ -0,0 +1,35 @@
+#ifndef BANKINDEX_H
+#define BANKINDEX_H
+/*
+ * bankindex.h
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+struct Bank_;
+
+/*
+ * Returns the FNV-1a hash of an account name and sets *length to its
+ * full length, so names sharing a prefix never compare equal.
+ */
+uint32_t
+bankhash( const char * name, size_t * length );
+
+/*
+ * Looks an account name up in the bank's index.  Safe to call without
+ * bankmutex from any process attached to the bank.
+ *
+ * Returns the ID (or index) of the account, -1 if not found.
+ */
+int
+bankindex_find( struct Bank_ * bank, const char * name );
+
+/*
+ * Adds the account with the given ID to the index.  The account name must
+ * already be in the name arena.  Must be called with bankmutex held.
+ *
+ * Returns 0 on success, -1 if the index is full.
+ */
+int
+bankindex_insert( struct Bank_ * bank, int id );
+#endif
@@ -0,0 +1,457 @@
+/*
+ * banklock.c
+ * Authors:	Emmanuel Baah
+ * 		Yuk Yan
+ *
+ * Locks for the Bank and its Accounts.  Every server process touches these
+ * mutexes through shared memory, so they must be process-shared, and since
+ * any session process may die while holding one they are also robust.
+ * glibc mutexes are futex based; banklock() adds a short spin before the
+ * futex wait since critical sections on the bank are only a few stores.
+ *
+ * With banklock_profiler set, every lock, unlock and condition wait also
+ * updates the LockProfile of the mutex, if it has one.  Time spent asleep
+ * on a condition variable counts as neither waiting nor holding.
+ */
+#include "banklock.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define banklock_relax()	__asm__ __volatile__("pause")
+#else
+#define banklock_relax()	__asm__ __volatile__("" ::: "memory")
+#endif
+
+LockProfile * (* banklock_profiler)( pthread_mutex_t * mutex );
+int		sessiongate_wakefd = -1;
+
+/*
+ * Returns the current time in nanoseconds.
+ */
+static uint64_t
+banklock_now( void )
+{
+	struct timespec		now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/*
+ * Profiles taking a mutex whose taker started trying at startns and
+ * waited for it if contended is set.  A startns of 0 means the mutex was
+ * taken back after a condition wait, which is not counted.
+ */
+static void
+banklock_acquired( pthread_mutex_t * mutex, uint64_t startns, int contended )
+{
+	LockProfile	* profile;
+	uint64_t	now;
+
+	if ( banklock_profiler == NULL || (profile = banklock_profiler( mutex )) == NULL )
+	{
+		return;
+	}
+	now = banklock_now();
+	if ( startns != 0 )
+	{
+		profile->acquired++;
+	}
+	if ( startns != 0 && contended )
+	{
+		profile->contended++;
+		profile->waitns += now - startns;
+		if ( now - startns > profile->maxwaitns )
+		{
+			profile->maxwaitns = now - startns;
+		}
+	}
+	profile->since = now;
+}
+
+/*
+ * Profiles letting go of a mutex.
+ */
+static void
+banklock_released( pthread_mutex_t * mutex )
+{
+	LockProfile	* profile;
+	uint64_t	held;
+
+	if ( banklock_profiler == NULL || (profile = banklock_profiler( mutex )) == NULL )
+	{
+		return;
+	}
+	held = banklock_now() - profile->since;
+	profile->holdns += held;
+	if ( held > profile->maxholdns )
+	{
+		profile->maxholdns = held;
+		profile->maxholder = getpid();
+	}
+}
+
+/*
+ * Initializes a mutex that lives in the shared bank.
+ *
+ * Returns 0 on success, an error number otherwise.
+ */
+int
+banklock_init( pthread_mutex_t * mutex )
+{
+	pthread_mutexattr_t	attr;
+	int			error;
+
+	if ( (error = pthread_mutexattr_init( &attr )) != 0 )
+	{
+		return error;
+	}
+	else if ( (error = pthread_mutexattr_setpshared( &attr, PTHREAD_PROCESS_SHARED )) != 0 )
+	{
+		errormessage("pthread_mutexattr_setpshared() failed");
+	}
+	else if ( (error = pthread_mutexattr_setrobust( &attr, PTHREAD_MUTEX_ROBUST )) != 0 )
+	{
+		errormessage("pthread_mutexattr_setrobust() failed");
+	}
+	else
+	{
+		error = pthread_mutex_init( mutex, &attr );
+	}
+	pthread_mutexattr_destroy( &attr );
+	return error;
+}
+
+/*
+ * Makes a mutex recovered from a dead owner usable again.
+ */
+static int
+banklock_recover( pthread_mutex_t * mutex )
+{
+	printf("[PID - %d]: Recovered a bank lock from a dead owner\n", getpid());
+	return pthread_mutex_consistent( mutex );
+}
+
+/*
+ * Tries to lock a bank mutex without blocking or profiling.
+ *
+ * Returns 0 on success, EBUSY if held, another error number otherwise.
+ */
+static int
+banklock_try( pthread_mutex_t * mutex )
+{
+	int	error;
+
+	if ( (error = pthread_mutex_trylock( mutex )) == EOWNERDEAD )
+	{
+		return banklock_recover( mutex );
+	}
+	return error;
+}
+
+/*
+ * Tries to lock a bank mutex without blocking.
+ *
+ * Returns 0 on success, EBUSY if held, another error number otherwise.
+ */
+int
+banktrylock( pthread_mutex_t * mutex )
+{
+	int	error;
+
+	if ( (error = banklock_try( mutex )) == 0 )
+	{
+		banklock_acquired( mutex, 1, 0 );
+	}
+	return error;
+}
+
+/*
+ * Locks a bank mutex, spinning briefly before blocking.
+ *
+ * Returns 0 on success, an error number otherwise.
+ */
+int
+banklock( pthread_mutex_t * mutex )
+{
+	uint64_t	start;
+	int		i, error;
+
+	start = banklock_profiler != NULL ? banklock_now() : 1;
+	for ( i = 0; i < BANKLOCK_SPIN; i++ )
+	{
+		if ( (error = banklock_try( mutex )) != EBUSY )
+		{
+			if ( error == 0 )
+			{
+				banklock_acquired( mutex, start, i > 0 );
+			}
+			return error;
+		}
+		banklock_relax();
+	}
+	if ( (error = pthread_mutex_lock( mutex )) == EOWNERDEAD )
+	{
+		error = banklock_recover( mutex );
+	}
+	if ( error == 0 )
+	{
+		banklock_acquired( mutex, start, 1 );
+	}
+	return error;
+}
+
+/*
+ * Unlocks a bank mutex.
+ *
+ * Returns 0 on success, an error number otherwise.
+ */
+int
+bankunlock( pthread_mutex_t * mutex )
+{
+	banklock_released( mutex );
+	return pthread_mutex_unlock( mutex );
+}
+
+/*
+ * Initializes a condition variable that lives in the shared bank.  It is
+ * PTHREAD_PROCESS_SHARED and times out against CLOCK_MONOTONIC.
+ *
+ * Returns 0 on success, an error number otherwise.
+ */
+int
+bankcond_init( pthread_cond_t * cond )
+{
+	pthread_condattr_t	attr;
+	int			error;
+
+	if ( (error = pthread_condattr_init( &attr )) != 0 )
+	{
+		return error;
+	}
+	else if ( (error = pthread_condattr_setpshared( &attr, PTHREAD_PROCESS_SHARED )) != 0 )
+	{
+		errormessage("pthread_condattr_setpshared() failed");
+	}
+	else if ( (error = pthread_condattr_setclock( &attr, CLOCK_MONOTONIC )) != 0 )
+	{
+		errormessage("pthread_condattr_setclock() failed");
+	}
+	else
+	{
+		error = pthread_cond_init( cond, &attr );
+	}
+	pthread_condattr_destroy( &attr );
+	return error;
+}
+
+/*
+ * Waits on a bank condition variable until the CLOCK_MONOTONIC deadline,
+ * recovering the mutex if its owner died meanwhile.
+ *
+ * Returns 0 when woken, ETIMEDOUT, or another error number.
+ */
+int
+bankcond_wait( pthread_cond_t * cond, pthread_mutex_t * mutex, const struct timespec * deadline )
+{
+	int	error;
+
+	banklock_released( mutex );
+	if ( (error = pthread_cond_timedwait( cond, mutex, deadline )) == EOWNERDEAD )
+	{
+		error = banklock_recover( mutex );
+	}
+	banklock_acquired( mutex, 0, 0 );
+	return error;
+}
+
+/*
+ * Initializes a session gate in the shared bank.
+ *
+ * Returns 0 on success, an error number otherwise.
+ */
+int
+sessiongate_init( SessionGate * gate )
+{
+	int			error;
+
+	gate->nextticket = gate->nowserving = 0;
+	bzero( gate->waiter, sizeof(gate->waiter) );
+	if ( (error = banklock_init( &gate->mutex )) != 0 )
+	{
+		return error;
+	}
+	return bankcond_init( &gate->cond );
+}
+
+/*
+ * Creates sessiongate_wakefd, once, before the event loops are started.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+sessiongate_wakeinit( void )
+{
+	if ( sessiongate_wakefd == -1 && (sessiongate_wakefd = eventfd(0, EFD_NONBLOCK)) == -1 )
+	{
+		errormessage("eventfd() failed");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Serves the next ticket that still has a waiter and wakes everyone
+ * waiting on the gate, sleeping or parked.  Called with the gate mutex
+ * held.
+ */
+static void
+sessiongate_advance( SessionGate * gate )
+{
+	uint64_t	one = 1;
+
+	gate->waiter[gate->nowserving % SESSIONGATE_QUEUE] = 0;
+	gate->nowserving++;
+	while ( gate->nowserving != gate->nextticket && gate->waiter[gate->nowserving % SESSIONGATE_QUEUE] == 0 )
+	{
+		gate->nowserving++;
+	}
+	pthread_cond_broadcast( &gate->cond );
+	if ( gate->nowserving != gate->nextticket && sessiongate_wakefd != -1 )
+	{
+		/* Only fails once the counter is full, and it is still readable then */
+		if ( write(sessiongate_wakefd, &one, sizeof(one)) == -1 )
+		{
+			return;
+		}
+	}
+}
+
+/*
+ * Passes the session on if the process holding it has died without
+ * leaving, and clears the account's ACCOUNT_INSESSION for it.  Called with
+ * the gate mutex held.
+ */
+static void
+sessiongate_reap( SessionGate * gate, uint8_t * flags )
+{
+	pid_t	pid;
+
+	while ( gate->nowserving != gate->nextticket
+		&& (pid = gate->waiter[gate->nowserving % SESSIONGATE_QUEUE]) != 0
+		&& kill(pid, 0) == -1 && errno == ESRCH )
+	{
+		printf("[PID - %d]: Session holder [PID - %d] died, passing the account on\n", getpid(), pid);
+		__atomic_and_fetch( flags, (uint8_t) ~ACCOUNT_INSESSION, __ATOMIC_RELAXED );
+		sessiongate_advance( gate );
+	}
+}
+
+/*
+ * Takes a ticket for the gate.  flags are those of the gate's account,
+ * see sessiongate_reap().
+ *
+ * Returns 0 if the session was free and now belongs to the caller, EBUSY if
+ * the caller is queued behind ticket, EAGAIN if the queue is full.
+ */
+int
+sessiongate_enter( SessionGate * gate, uint8_t * flags, unsigned int * ticket )
+{
+	int	rv;
+
+	banklock( &gate->mutex );
+	sessiongate_reap( gate, flags );
+	if ( gate->nextticket - gate->nowserving >= SESSIONGATE_QUEUE )
+	{
+		rv = EAGAIN;
+	}
+	else
+	{
+		*ticket = gate->nextticket++;
+		gate->waiter[*ticket % SESSIONGATE_QUEUE] = getpid();
+		rv = *ticket == gate->nowserving ? 0 : EBUSY;
+	}
+	bankunlock( &gate->mutex );
+	return rv;
+}
+
+/*
+ * Sleeps until ticket is served or the CLOCK_MONOTONIC deadline passes.
+ * The wait is sliced so that a dead holder is noticed within a second.
+ *
+ * Returns 0 once the session belongs to the caller, ETIMEDOUT otherwise.
+ */
+int
+sessiongate_wait( SessionGate * gate, uint8_t * flags, unsigned int ticket, const struct timespec * deadline )
+{
+	struct timespec		slice;
+	int			error;
+
+	banklock( &gate->mutex );
+	while ( sessiongate_reap( gate, flags ), gate->nowserving != ticket )
+	{
+		clock_gettime( CLOCK_MONOTONIC, &slice );
+		slice.tv_sec++;
+		if ( deadline != NULL && (deadline->tv_sec < slice.tv_sec
+			|| (deadline->tv_sec == slice.tv_sec && deadline->tv_nsec < slice.tv_nsec)) )
+		{
+			slice = *deadline;
+		}
+		error = bankcond_wait( &gate->cond, &gate->mutex, &slice );
+		if ( error == ETIMEDOUT && deadline != NULL
+			&& slice.tv_sec == deadline->tv_sec && slice.tv_nsec == deadline->tv_nsec
+			&& gate->nowserving != ticket )
+		{
+			bankunlock( &gate->mutex );
+			return ETIMEDOUT;
+		}
+	}
+	bankunlock( &gate->mutex );
+	return 0;
+}
+
+/*
+ * Checks without sleeping whether ticket is being served.
+ *
+ * Returns 0 once the session belongs to the caller, EBUSY otherwise.
+ */
+int
+sessiongate_poll( SessionGate * gate, uint8_t * flags, unsigned int ticket )
+{
+	int	rv;
+
+	banklock( &gate->mutex );
+	sessiongate_reap( gate, flags );
+	rv = gate->nowserving == ticket ? 0 : EBUSY;
+	bankunlock( &gate->mutex );
+	return rv;
+}
+
+/*
+ * Gives up a queued ticket.  If the ticket was already served the session
+ * is passed on to the next waiter.
+ */
+void
+sessiongate_cancel( SessionGate * gate, unsigned int ticket )
+{
+	banklock( &gate->mutex );
+	if ( gate->nowserving == ticket )
+	{
+		sessiongate_advance( gate );
+	}
+	else
+	{
+		gate->waiter[ticket % SESSIONGATE_QUEUE] = 0;
+	}
+	bankunlock( &gate->mutex );
+}
+
+/*
+ * Ends the session held by the caller and wakes the next waiter.
+ */
+void
+sessiongate_leave( SessionGate * gate )
+{
+	banklock( &gate->mutex );
+	sessiongate_advance( gate );
+	bankunlock( &gate->mutex );
+}
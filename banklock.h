@@ -0,0 +1,186 @@
+#ifndef BANKLOCK_H
+#define BANKLOCK_H
+/*
+ * banklock.h
+ */
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/eventfd.h>
+
+/*
+ * Number of trylock attempts made before sleeping in the kernel.
+ */
+#define BANKLOCK_SPIN		100
+
+/*
+ * Maximum number of clients queued on one account.
+ */
+#define SESSIONGATE_QUEUE	64
+
+/*
+ * A FIFO queue of clients waiting to start a session on an account.
+ *
+ * Every client takes a ticket; the session belongs to the client whose
+ * ticket is nowserving.  waiter[] holds the PID behind each outstanding
+ * ticket (0 once abandoned) so dead holders and cancelled waiters are
+ * skipped.  The gate is free when nowserving == nextticket.
+ */
+struct SessionGate_ {
+	pthread_mutex_t		mutex;
+	pthread_cond_t		cond;
+	unsigned int		nextticket;
+	unsigned int		nowserving;
+	pid_t			waiter[SESSIONGATE_QUEUE];
+};
+
+typedef struct SessionGate_ SessionGate;
+
+/*
+ * eventfd written whenever a gate passes a session on to a waiter, -1
+ * until sessiongate_wakeinit().  Event loops watch it edge triggered
+ * instead of polling their parked sessions.  Nobody reads it: each write
+ * is an edge for every loop watching, and a read by one loop could hide
+ * the next edge from the others.
+ */
+extern int		sessiongate_wakefd;
+
+/*
+ * Lock profile of one bank mutex: how often it was taken and how often
+ * the taker had to wait, the total and longest wait, and the total and
+ * longest time it was held, in nanoseconds, with the PID that held it
+ * longest.  since is when the current holder took it.  Every field is
+ * only written by the holder of the mutex, so none needs to be atomic.
+ */
+struct LockProfile_ {
+	uint64_t		acquired;
+	uint64_t		contended;
+	uint64_t		waitns;
+	uint64_t		maxwaitns;
+	uint64_t		holdns;
+	uint64_t		maxholdns;
+	uint64_t		since;
+	pid_t			maxholder;
+};
+
+typedef struct LockProfile_ LockProfile;
+
+/*
+ * Returns the profile of a mutex, NULL if it is not profiled.  Unset
+ * (the default) turns profiling off; see banklockprof.c.
+ */
+extern LockProfile * (* banklock_profiler)( pthread_mutex_t * mutex );
+
+/*
+ * Initializes a mutex that lives in the shared bank.  The mutex is
+ * PTHREAD_PROCESS_SHARED and PTHREAD_MUTEX_ROBUST, so a process dying while
+ * holding it does not leave it locked forever.
+ *
+ * Returns 0 on success, an error number otherwise.
+ */
+int
+banklock_init( pthread_mutex_t * mutex );
+
+/*
+ * Locks a bank mutex, spinning briefly before blocking.  A mutex left
+ * locked by a dead owner is recovered and made consistent.
+ *
+ * Returns 0 on success, an error number otherwise.
+ */
+int
+banklock( pthread_mutex_t * mutex );
+
+/*
+ * Tries to lock a bank mutex without blocking, recovering it from a dead
+ * owner if needed.
+ *
+ * Returns 0 on success, EBUSY if held, another error number otherwise.
+ */
+int
+banktrylock( pthread_mutex_t * mutex );
+
+/*
+ * Unlocks a bank mutex.
+ *
+ * Returns 0 on success, an error number otherwise.
+ */
+int
+bankunlock( pthread_mutex_t * mutex );
+
+/*
+ * Initializes a condition variable that lives in the shared bank.  It is
+ * PTHREAD_PROCESS_SHARED and times out against CLOCK_MONOTONIC.
+ *
+ * Returns 0 on success, an error number otherwise.
+ */
+int
+bankcond_init( pthread_cond_t * cond );
+
+/*
+ * Waits on a bank condition variable until the CLOCK_MONOTONIC deadline,
+ * recovering the mutex if its owner died meanwhile.
+ *
+ * Returns 0 when woken, ETIMEDOUT, or another error number.
+ */
+int
+bankcond_wait( pthread_cond_t * cond, pthread_mutex_t * mutex, const struct timespec * deadline );
+
+/*
+ * Initializes a session gate in the shared bank.
+ *
+ * Returns 0 on success, an error number otherwise.
+ */
+int
+sessiongate_init( SessionGate * gate );
+
+/*
+ * Creates sessiongate_wakefd, once, before the event loops are started.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+sessiongate_wakeinit( void );
+
+/*
+ * Takes a ticket for the gate.  flags are those of the gate's account:
+ * here and in sessiongate_wait() and sessiongate_poll(), passing over a
+ * dead holder clears its ACCOUNT_INSESSION.
+ *
+ * Returns 0 if the session was free and now belongs to the caller, EBUSY if
+ * the caller is queued behind ticket, EAGAIN if the queue is full.
+ */
+int
+sessiongate_enter( SessionGate * gate, uint8_t * flags, unsigned int * ticket );
+
+/*
+ * Sleeps until ticket is served or the CLOCK_MONOTONIC deadline passes.
+ * A NULL deadline waits forever.  The ticket stays queued on timeout.
+ *
+ * Returns 0 once the session belongs to the caller, ETIMEDOUT otherwise.
+ */
+int
+sessiongate_wait( SessionGate * gate, uint8_t * flags, unsigned int ticket, const struct timespec * deadline );
+
+/*
+ * Checks without sleeping whether ticket is being served.
+ *
+ * Returns 0 once the session belongs to the caller, EBUSY otherwise.
+ */
+int
+sessiongate_poll( SessionGate * gate, uint8_t * flags, unsigned int ticket );
+
+/*
+ * Gives up a queued ticket.  If the ticket was already served the session
+ * is passed on to the next waiter.
+ */
+void
+sessiongate_cancel( SessionGate * gate, unsigned int ticket );
+
+/*
+ * Ends the session held by the caller and wakes the next waiter.
+ */
+void
+sessiongate_leave( SessionGate * gate );
+#endif
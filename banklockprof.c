@@ -0,0 +1,203 @@
+/*
+ * banklockprof.c
+ * Authors:	Emmanuel Baah
+ * 		Yuk Yan
+ *
+ * Lock contention profiler (-p).  banklock.c updates a LockProfile for
+ * every mutex banklock_profiler finds one for; this file finds them.  The
+ * profiles live in a MAP_SHARED anonymous mapping made before the server
+ * forks: one for bankmutex, one for the log mutex and one per account, for
+ * the mutex of its session gate.  A mutex is
+ * recognised by its address in the bank, so the lock calls themselves do
+ * not change.
+ */
+#include "banklockprof.h"
+
+#define LOCKPROF_BANK		0
+#define LOCKPROF_WAL		1
+#define LOCKPROF_SESSION(id)	(2 + (id))
+
+static Bank		* lockbank;
+static LockProfile	* profiles;
+
+/*
+ * Returns the profile of a mutex of the bank, NULL if it has none.
+ */
+static LockProfile *
+lockprof_find( pthread_mutex_t * mutex )
+{
+	size_t		offset;
+	int		id;
+
+	if ( mutex == &lockbank->bankmutex )
+	{
+		return &profiles[LOCKPROF_BANK];
+	}
+	else if ( mutex == &lockbank->wal.mutex )
+	{
+		return &profiles[LOCKPROF_WAL];
+	}
+	else if ( (char *) mutex < (char *) bankaccount( lockbank, 0 )
+		|| (char *) mutex >= (char *) bankaccount( lockbank, lockbank->maxaccounts ) )
+	{
+		return NULL;
+	}
+	offset = (char *) mutex - (char *) bankaccount( lockbank, 0 );
+	id = offset / sizeof(Account);
+	offset %= sizeof(Account);
+	if ( offset == offsetof(Account, clientsession.mutex) )
+	{
+		return &profiles[LOCKPROF_SESSION(id)];
+	}
+	return NULL;
+}
+
+/*
+ * Starts profiling the mutexes of the bank.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+lockprof_init( Bank * bank )
+{
+	if ( (profiles = mmap(0, LOCKPROF_SESSION(bank->maxaccounts) * sizeof(LockProfile), PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED )
+	{
+		errormessage("mmap() failed");
+		profiles = NULL;
+		return -1;
+	}
+	lockbank = bank;
+	banklock_profiler = lockprof_find;
+	return 0;
+}
+
+/*
+ * Adds one line about a profile, or a sum of profiles, to the report.
+ *
+ * Returns the length of the line.
+ */
+static int
+lockprof_line( char * buffer, size_t size, const char * label, const char * name, LockProfile * profile )
+{
+	return snprintf(buffer, size, "%-8s %-16.16s %10llu %10llu %10.1f %10.1f %10.1f %10.1f\n", label, name,
+		(unsigned long long) profile->acquired, (unsigned long long) profile->contended,
+		profile->waitns / 1e6, profile->maxwaitns / 1e3, profile->holdns / 1e6, profile->maxholdns / 1e3);
+}
+
+/*
+ * Adds a profile to a running sum.
+ */
+static void
+lockprof_add( LockProfile * sum, const LockProfile * profile )
+{
+	sum->acquired += profile->acquired;
+	sum->contended += profile->contended;
+	sum->waitns += profile->waitns;
+	sum->holdns += profile->holdns;
+	if ( profile->maxwaitns > sum->maxwaitns )
+	{
+		sum->maxwaitns = profile->maxwaitns;
+	}
+	if ( profile->maxholdns > sum->maxholdns )
+	{
+		sum->maxholdns = profile->maxholdns;
+	}
+}
+
+/*
+ * Keeps the LOCKPROF_TOP largest keys seen in top[] and their slots in
+ * slots[], largest first.
+ */
+static void
+lockprof_rank( uint64_t * top, int * slots, uint64_t key, int slot )
+{
+	int		i;
+
+	if ( key == 0 || key <= top[LOCKPROF_TOP - 1] )
+	{
+		return;
+	}
+	for ( i = LOCKPROF_TOP - 1; i > 0 && top[i - 1] < key; i-- )
+	{
+		top[i] = top[i - 1];
+		slots[i] = slots[i - 1];
+	}
+	top[i] = key;
+	slots[i] = slot;
+}
+
+/*
+ * Returns a label for the lock of a profile slot, and sets *name to the
+ * name of its account, if any.
+ */
+static const char *
+lockprof_label( int slot, const char ** name )
+{
+	*name = "";
+	if ( slot == LOCKPROF_BANK )
+	{
+		return "bank";
+	}
+	else if ( slot == LOCKPROF_WAL )
+	{
+		return "wal";
+	}
+	*name = bankname( lockbank, slot - LOCKPROF_SESSION(0) );
+	return "session";
+}
+
+/*
+ * Writes a report of the profiled mutexes.  Times are in milliseconds for
+ * totals and microseconds for maxima.
+ *
+ * Returns the length of the report, 0 if locks are not profiled.
+ */
+int
+lockprof_report( char * buffer, size_t size )
+{
+	LockProfile	session;
+	uint64_t	waits[LOCKPROF_TOP], holds[LOCKPROF_TOP];
+	int		waited[LOCKPROF_TOP], held[LOCKPROF_TOP];
+	const char	* name, * label;
+	int		i, n, slot, accounts;
+
+	if ( profiles == NULL )
+	{
+		return 0;
+	}
+	memset(&session, 0, sizeof(session));
+	memset(waits, 0, sizeof(waits));
+	memset(holds, 0, sizeof(holds));
+	accounts = __atomic_load_n( &lockbank->numaccounts, __ATOMIC_ACQUIRE );
+	for ( slot = 0; slot < LOCKPROF_SESSION(accounts); slot++ )
+	{
+		if ( slot >= LOCKPROF_SESSION(0) )
+		{
+			lockprof_add( &session, &profiles[slot] );
+			/* Rank accounts by the time waited on their session queue */
+			lockprof_rank( waits, waited, profiles[slot].waitns, slot );
+		}
+		lockprof_rank( holds, held, profiles[slot].maxholdns, slot );
+	}
+
+	n = snprintf(buffer, size, "%-8s %-16s %10s %10s %10s %10s %10s %10s\n", "lock", "account",
+		"acquired", "contended", "wait ms", "maxwait us", "hold ms", "maxhold us");
+	n += lockprof_line( buffer + n, size - n, "bank", "", &profiles[LOCKPROF_BANK] );
+	n += lockprof_line( buffer + n, size - n, "wal", "", &profiles[LOCKPROF_WAL] );
+	n += lockprof_line( buffer + n, size - n, "session", "(all accounts)", &session );
+	n += snprintf(buffer + n, size - n, "Hottest accounts:\n");
+	for ( i = 0; i < LOCKPROF_TOP && waits[i] != 0; i++ )
+	{
+		name = bankname( lockbank, waited[i] - LOCKPROF_SESSION(0) );
+		n += lockprof_line( buffer + n, size - n, "session", name, &profiles[waited[i]] );
+	}
+	n += snprintf(buffer + n, size - n, "Longest holders:\n");
+	for ( i = 0; i < LOCKPROF_TOP && holds[i] != 0; i++ )
+	{
+		label = lockprof_label( held[i], &name );
+		n += snprintf(buffer + n, size - n, "%-8s %-16.16s %10.1f us by PID %d\n", label, name,
+			holds[i] / 1e3, profiles[held[i]].maxholder);
+	}
+	return n;
+}
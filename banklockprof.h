@@ -0,0 +1,41 @@
+#ifndef BANKLOCKPROF_H
+#define BANKLOCKPROF_H
+/*
+ * banklockprof.h
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+/*
+ * Number of accounts and of holders listed by lockprof_report().
+ */
+#define LOCKPROF_TOP		5
+
+/*
+ * Room needed for a lock report.
+ */
+#define LOCKPROF_REPORTMAX	(100 * (8 + 3 * LOCKPROF_TOP))
+
+struct Bank_;
+
+/*
+ * Starts profiling the mutexes of the bank: bankmutex, the log mutex and
+ * the session gate mutex of every account.  The
+ * profiles are shared with processes fork()ed afterwards.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+lockprof_init( struct Bank_ * bank );
+
+/*
+ * Writes a report of the profiled mutexes to buffer, which holds size
+ * bytes (LOCKPROF_REPORTMAX is enough): totals for each kind of lock, the
+ * accounts whose locks were waited for longest and the longest holds.
+ *
+ * Returns the length of the report, 0 if locks are not profiled.
+ */
+int
+lockprof_report( char * buffer, size_t size );
+#endif
@@ -0,0 +1,350 @@
+/*
+ * banklog.c
+ * Authors:	Emmanuel Baah
+ * 		Yuk Yan
+ *
+ * Asynchronous log of the session paths.  Instead of printf()ing, and
+ * waiting on a slow terminal or pipe, a session stores a binary record (an
+ * event code, two integers and a little text) into a ring shared by every
+ * server process, and a drain thread in the server formats the records
+ * and writes them to stdout.
+ *
+ * The ring is a bounded multi-producer queue without locks.  Every slot
+ * carries a sequence number: a slot at position p is free while its seq
+ * is p, a producer claims it by advancing head with a compare-and-swap,
+ * fills it and publishes it by setting seq to p + 1, and the drain frees
+ * it for the next lap by setting seq to p + LOG_RECORDS.  A full ring
+ * drops the record instead of waiting.
+ *
+ * A session killed between claiming and publishing a slot would stop the
+ * drain at that slot, so a slot left claimed for LOG_STALLS drains is
+ * skipped and counted as dropped.
+ */
+#include "banklog.h"
+
+/*
+ * Drains a claimed slot may stay unpublished for before it is skipped.
+ */
+#define LOG_STALLS		100
+
+/*
+ * Longest line logformat() writes, and room for the lines of one drain.
+ */
+#define LOG_LINEMAX		256
+#define LOG_DRAINBUF		8192
+
+/*
+ * The shared ring.  head and tail live on their own cache lines so that
+ * producers and the drain do not bounce each other's.
+ */
+struct LogRing_ {
+	uint64_t		head __attribute__((aligned(BANK_CACHELINE)));
+	uint64_t		tail __attribute__((aligned(BANK_CACHELINE)));
+	uint64_t		dropped;
+	LogRecord		records[LOG_RECORDS] __attribute__((aligned(BANK_CACHELINE)));
+};
+typedef struct LogRing_ LogRing;
+
+/*
+ * Level of each event.
+ */
+static const uint8_t	loglevels[LOG_EVENTS] = {
+	[LOG_CLIENT] = LOGLEVEL_DEBUG,
+	[LOG_ACCEPTED] = LOGLEVEL_INFO,
+	[LOG_CONNECTED] = LOGLEVEL_INFO,
+	[LOG_CLOSED] = LOGLEVEL_INFO,
+	[LOG_FORKED] = LOGLEVEL_INFO,
+	[LOG_OPENED] = LOGLEVEL_INFO,
+	[LOG_BANKFULL] = LOGLEVEL_WARN,
+	[LOG_EXISTS] = LOGLEVEL_WARN,
+	[LOG_NEGATIVE] = LOGLEVEL_WARN,
+	[LOG_CREDITED] = LOGLEVEL_INFO,
+	[LOG_DEBITED] = LOGLEVEL_INFO,
+	[LOG_NOFUNDS] = LOGLEVEL_WARN,
+	[LOG_BALANCE] = LOGLEVEL_INFO,
+	[LOG_STARTED] = LOGLEVEL_INFO,
+	[LOG_INSESSION] = LOGLEVEL_WARN,
+	[LOG_NOSESSION] = LOGLEVEL_WARN,
+	[LOG_CREDITING] = LOGLEVEL_DEBUG,
+	[LOG_DEBITING] = LOGLEVEL_DEBUG,
+	[LOG_PRINTING] = LOGLEVEL_DEBUG,
+	[LOG_BATCH] = LOGLEVEL_INFO,
+	[LOG_ENDING] = LOGLEVEL_INFO,
+	[LOG_OVERFLOW] = LOGLEVEL_WARN,
+};
+
+static LogRing		* logring;
+static int		loglevel;
+
+/*
+ * Drains of one process take turns, the stall counters in logdrain() are
+ * theirs.
+ */
+static pthread_mutex_t	logdrainmutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Creates the log ring, keeping records up to level.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+loginit( int level )
+{
+	uint64_t	i;
+
+	if ( (logring = mmap(0, sizeof(LogRing), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED )
+	{
+		errormessage("mmap() failed");
+		logring = NULL;
+		return -1;
+	}
+	for ( i = 0; i < LOG_RECORDS; i++ )
+	{
+		logring->records[i].seq = i;
+	}
+	loglevel = level;
+	return 0;
+}
+
+/*
+ * Queues a record of event.
+ */
+void
+logevent( int event, int64_t a, int64_t b, const char * text, size_t length )
+{
+	LogRecord	* record;
+	uint64_t	position, seq;
+
+	if ( logring == NULL || loglevels[event] > loglevel )
+	{
+		return;
+	}
+	position = __atomic_load_n( &logring->head, __ATOMIC_RELAXED );
+	while ( 1 )
+	{
+		record = &logring->records[position % LOG_RECORDS];
+		seq = __atomic_load_n( &record->seq, __ATOMIC_ACQUIRE );
+		if ( seq == position )
+		{
+			if ( __atomic_compare_exchange_n( &logring->head, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+			{
+				break;
+			}
+		}
+		else if ( (int64_t) (seq - position) < 0 )
+		{
+			/* Full, the drain has not freed this slot from the last lap */
+			__atomic_fetch_add( &logring->dropped, 1, __ATOMIC_RELAXED );
+			return;
+		}
+		else
+		{
+			position = __atomic_load_n( &logring->head, __ATOMIC_RELAXED );
+		}
+	}
+	record->event = event;
+	record->a = a;
+	record->b = b;
+	record->length = text == NULL ? 0 : length > LOG_TEXTMAX ? LOG_TEXTMAX : length;
+	if ( record->length > 0 )
+	{
+		memcpy(record->text, text, record->length);
+	}
+	/* Fails only if the drain gave up on the slot, see logdrain() */
+	seq = position;
+	__atomic_compare_exchange_n( &record->seq, &seq, position + 1, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED );
+}
+
+/*
+ * Formats one record as the line the server used to print for it.
+ *
+ * Returns the length of the line, at most size - 1.
+ */
+static size_t
+logformat( const LogRecord * record, char * line, size_t size )
+{
+	char		amount[AMOUNT_STRLEN];
+	int		length, n;
+
+	length = record->length > LOG_TEXTMAX ? LOG_TEXTMAX : record->length;
+	switch ( record->event )
+	{
+		case LOG_CLIENT:
+			while ( length > 0 && (record->text[length - 1] == '\n' || record->text[length - 1] == '\r') )
+			{
+				length--;
+			}
+			n = snprintf(line, size, "client entered:%.*s\n", length, record->text);
+			break;
+		case LOG_ACCEPTED:
+			n = snprintf(line, size, "======================\nConnection established\n======================\n");
+			break;
+		case LOG_CONNECTED:
+			n = snprintf(line, size, "Connection established\n");
+			break;
+		case LOG_CLOSED:
+			n = snprintf(line, size, "Connection closed\n");
+			break;
+		case LOG_FORKED:
+			n = snprintf(line, size, "[PID - %d]: Created child process with [PID - %d]\n", (int) record->a, (int) record->b);
+			break;
+		case LOG_OPENED:
+			n = snprintf(line, size, "Account %d: %.*s successfully created.\n", (int) record->a, length, record->text);
+			break;
+		case LOG_BANKFULL:
+			n = snprintf(line, size, "Could not create account: Bank is full.\n");
+			break;
+		case LOG_EXISTS:
+			n = snprintf(line, size, "An account with that name already exists.\n");
+			break;
+		case LOG_NEGATIVE:
+			n = snprintf(line, size, "Cannot %s a negative amount.\n", record->a == COMMAND_DEBIT ? "debit" : "credit");
+			break;
+		case LOG_CREDITED:
+			n = snprintf(line, size, "Credit successful, current balance: %s\n", formatamount( record->b, amount ));
+			break;
+		case LOG_DEBITED:
+			n = snprintf(line, size, "Debit successful, current balance: %s\n", formatamount( record->b, amount ));
+			break;
+		case LOG_NOFUNDS:
+			n = snprintf(line, size, "Insufficient funds.\n");
+			break;
+		case LOG_BALANCE:
+			n = snprintf(line, size, "Current balance for %.*s: %s\n", length, record->text, formatamount( record->b, amount ));
+			break;
+		case LOG_STARTED:
+			n = snprintf(line, size, "Session starting for: \n");
+			break;
+		case LOG_INSESSION:
+			n = snprintf(line, size, "Currently in session\n");
+			break;
+		case LOG_NOSESSION:
+			n = snprintf(line, size, "Need to be in session\n");
+			break;
+		case LOG_CREDITING:
+			n = snprintf(line, size, "Crediting account\n");
+			break;
+		case LOG_DEBITING:
+			n = snprintf(line, size, "Debiting account\n");
+			break;
+		case LOG_PRINTING:
+			n = snprintf(line, size, "Printing account balance\n");
+			break;
+		case LOG_BATCH:
+			n = snprintf(line, size, "Batch of %d operations: %.*s\n", (int) record->a, length, record->text);
+			break;
+		case LOG_ENDING:
+			n = snprintf(line, size, "Ending session now\n");
+			break;
+		case LOG_OVERFLOW:
+			n = snprintf(line, size, "Credit would overflow the balance.\n");
+			break;
+		default:
+			n = snprintf(line, size, "Unknown log event %d\n", record->event);
+			break;
+	}
+	return n < 0 ? 0 : (size_t) n >= size ? size - 1 : (size_t) n;
+}
+
+/*
+ * Writes length bytes to stdout, giving up on errors.
+ */
+static void
+logwrite( const char * data, size_t length )
+{
+	ssize_t		n;
+
+	for ( ; length > 0; data += n, length -= n )
+	{
+		if ( (n = write(1, data, length)) == -1 )
+		{
+			if ( errno != EINTR )
+			{
+				return;
+			}
+			n = 0;
+		}
+	}
+}
+
+/*
+ * Formats and writes every published record, in order.
+ *
+ * Returns the number of records written.
+ */
+int
+logdrain( void )
+{
+	static uint64_t		stalled, reported;
+	static int		stalls;
+	LogRecord		record, * slot;
+	uint64_t		position, seq, dropped;
+	char			buffer[LOG_DRAINBUF];
+	size_t			used;
+	int			count;
+
+	if ( logring == NULL )
+	{
+		return 0;
+	}
+	pthread_mutex_lock( &logdrainmutex );
+	for ( used = 0, count = 0; ; )
+	{
+		if ( used + LOG_LINEMAX > sizeof(buffer) )
+		{
+			logwrite( buffer, used );
+			used = 0;
+		}
+		position = __atomic_load_n( &logring->tail, __ATOMIC_ACQUIRE );
+		slot = &logring->records[position % LOG_RECORDS];
+		seq = __atomic_load_n( &slot->seq, __ATOMIC_ACQUIRE );
+		if ( seq == position + 1 )
+		{
+			memcpy(&record, slot, sizeof(record));
+			/* Only one drain may take it, the losers look again */
+			if ( !__atomic_compare_exchange_n( &logring->tail, &position, position + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ) )
+			{
+				continue;
+			}
+			__atomic_store_n( &slot->seq, position + LOG_RECORDS, __ATOMIC_RELEASE );
+			used += logformat( &record, buffer + used, LOG_LINEMAX );
+			count++;
+			stalls = 0;
+		}
+		else if ( seq != position || position == __atomic_load_n( &logring->head, __ATOMIC_ACQUIRE ) )
+		{
+			/* Nothing more published */
+			break;
+		}
+		else if ( position != stalled || ++stalls < LOG_STALLS )
+		{
+			/* Claimed but not published yet, look again next time */
+			if ( position != stalled )
+			{
+				stalled = position;
+				stalls = 0;
+			}
+			break;
+		}
+		else if ( __atomic_compare_exchange_n( &slot->seq, &seq, position + LOG_RECORDS, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ) )
+		{
+			/* Its session died writing it, skip it */
+			__atomic_compare_exchange_n( &logring->tail, &position, position + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED );
+			__atomic_fetch_add( &logring->dropped, 1, __ATOMIC_RELAXED );
+			stalls = 0;
+		}
+	}
+	if ( (dropped = __atomic_load_n( &logring->dropped, __ATOMIC_RELAXED )) != reported )
+	{
+		if ( used + LOG_LINEMAX > sizeof(buffer) )
+		{
+			logwrite( buffer, used );
+			used = 0;
+		}
+		used += snprintf(buffer + used, LOG_LINEMAX, "%llu log records dropped\n", (unsigned long long) (dropped - reported));
+		reported = dropped;
+	}
+	logwrite( buffer, used );
+	pthread_mutex_unlock( &logdrainmutex );
+	return count;
+}
@@ -0,0 +1,103 @@
+#ifndef BANKLOG_H
+#define BANKLOG_H
+/*
+ * banklog.h
+ */
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/*
+ * Log levels, set with -L.  A record is kept if its level is at most the
+ * one set.
+ */
+#define LOGLEVEL_WARN		0
+#define LOGLEVEL_INFO		1
+#define LOGLEVEL_DEBUG		2
+
+/*
+ * Log events.  Each is formatted by the drain, see logformat(), from the
+ * integer a, the amount b and the text of the record.
+ */
+#define LOG_CLIENT		0	/* text: command line */
+#define LOG_ACCEPTED		1
+#define LOG_CONNECTED		2
+#define LOG_CLOSED		3
+#define LOG_FORKED		4	/* a: parent PID, b: child PID */
+#define LOG_OPENED		5	/* a: account number, text: name */
+#define LOG_BANKFULL		6
+#define LOG_EXISTS		7
+#define LOG_NEGATIVE		8	/* a: COMMAND_CREDIT or COMMAND_DEBIT */
+#define LOG_CREDITED		9	/* b: balance */
+#define LOG_DEBITED		10	/* b: balance */
+#define LOG_NOFUNDS		11
+#define LOG_BALANCE		12	/* b: balance, text: name */
+#define LOG_STARTED		13
+#define LOG_INSESSION		14
+#define LOG_NOSESSION		15
+#define LOG_CREDITING		16
+#define LOG_DEBITING		17
+#define LOG_PRINTING		18
+#define LOG_BATCH		19	/* a: operations, text: results */
+#define LOG_ENDING		20
+#define LOG_OVERFLOW		21
+#define LOG_EVENTS		22
+
+/*
+ * Records in the ring.  When it is full new records are dropped and
+ * counted, sessions never wait for the log.
+ */
+#define LOG_RECORDS		4096
+
+/*
+ * Text kept per record, filling it to 128 bytes.  Longer text is cut.
+ */
+#define LOG_TEXTMAX		101
+
+/*
+ * Interval of the drain thread.
+ */
+#define LOG_DRAIN_MS		10
+
+/*
+ * One log record, binary encoded.  seq tells who owns the slot, see
+ * banklog.c.
+ */
+struct LogRecord_ {
+	uint64_t		seq;
+	int64_t			a;
+	int64_t			b;
+	uint16_t		event;
+	uint8_t			length;
+	char			text[LOG_TEXTMAX];
+};
+typedef struct LogRecord_ LogRecord;
+
+/*
+ * Creates the log ring, keeping records up to level.  The ring is shared
+ * with processes fork()ed afterwards.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+loginit( int level );
+
+/*
+ * Queues a record of event with the integers a and b and length bytes of
+ * text, which may be NULL.  Never blocks.  Records are printed to stdout
+ * by logdrain().
+ */
+void
+logevent( int event, int64_t a, int64_t b, const char * text, size_t length );
+
+/*
+ * Formats the queued records of every process and writes them to stdout.
+ *
+ * Returns the number of records written.
+ */
+int
+logdrain( void );
+#endif
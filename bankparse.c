@@ -0,0 +1,105 @@
+/*
+ * bankparse.c
+ * Authors:	Emmanuel Baah
+ * 		Yuk Yan
+ *
+ * Command line parser.  Lines are parsed where they sit in the session's
+ * input buffer: the verb and argument are NUL terminated in place and the
+ * verb is dispatched on its length and then a single memcmp(), so parsing
+ * costs the same for every command and never allocates.
+ */
+#include "bankparse.h"
+
+/*
+ * Returns the COMMAND_ code of a verb, COMMAND_ERROR if unknown.
+ */
+static int
+parseverb( const char * verb, int length )
+{
+	switch ( length )
+	{
+		case 4:
+			if ( memcmp(verb, "open", 4) == 0 )
+			{
+				return COMMAND_OPEN;
+			}
+			else if ( memcmp(verb, "exit", 4) == 0 )
+			{
+				return COMMAND_EXIT;
+			}
+			break;
+		case 5:
+			if ( memcmp(verb, "batch", 5) == 0 )
+			{
+				return COMMAND_BATCH;
+			}
+			else if ( memcmp(verb, "start", 5) == 0 )
+			{
+				return COMMAND_START;
+			}
+			else if ( memcmp(verb, "debit", 5) == 0 )
+			{
+				return COMMAND_DEBIT;
+			}
+			else if ( memcmp(verb, "stats", 5) == 0 )
+			{
+				return COMMAND_STATS;
+			}
+			break;
+		case 6:
+			if ( memcmp(verb, "credit", 6) == 0 )
+			{
+				return COMMAND_CREDIT;
+			}
+			else if ( memcmp(verb, "finish", 6) == 0 )
+			{
+				return COMMAND_FINISH;
+			}
+			else if ( memcmp(verb, "binary", 6) == 0 )
+			{
+				return COMMAND_BINARY;
+			}
+			break;
+		case 7:
+			if ( memcmp(verb, "balance", 7) == 0 )
+			{
+				return COMMAND_BALANCE;
+			}
+			else if ( memcmp(verb, "machine", 7) == 0 )
+			{
+				return COMMAND_MACHINE;
+			}
+			break;
+	}
+	return COMMAND_ERROR;
+}
+
+/*
+ * Parses one command line in place, without allocating.
+ *
+ * Returns the COMMAND_ code of the verb, COMMAND_ERROR if unknown.
+ */
+int
+parsecommand( char * line, int length, char ** argument )
+{
+	char	* space;
+	int	verblength;
+
+	while ( length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r') )
+	{
+		length--;
+	}
+	line[length] = '\0';
+	if ( (space = memchr(line, ' ', length)) != NULL )
+	{
+		*space = '\0';
+		verblength = space - line;
+		*argument = space + 1;
+	}
+	else
+	{
+		verblength = length;
+		*argument = line + length;
+	}
+	return parseverb( line, verblength );
+}
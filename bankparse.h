@@ -0,0 +1,34 @@
+#ifndef BANKPARSE_H
+#define BANKPARSE_H
+/*
+ * bankparse.h
+ */
+
+/*
+ * Commands returned by parsecommand().
+ */
+#define COMMAND_ERROR		-1
+#define COMMAND_OPEN		0
+#define COMMAND_START		1
+#define COMMAND_CREDIT		2
+#define COMMAND_DEBIT		3
+#define COMMAND_BALANCE		4
+#define COMMAND_FINISH		5
+#define COMMAND_EXIT		6
+#define COMMAND_BINARY		7
+#define COMMAND_MACHINE		8
+#define COMMAND_BATCH		9
+#define COMMAND_STATS		10
+
+/*
+ * Parses one command line in place, without allocating.  The line may end
+ * in "\n" or "\r\n" and line[length] must be writable.  The verb ends at
+ * the first space and the rest of the line is the argument, which is NUL
+ * terminated in place.
+ *
+ * Returns the COMMAND_ code of the verb, COMMAND_ERROR if unknown.
+ * *argument points at the (possibly empty) argument inside line.
+ */
+int
+parsecommand( char * line, int length, char ** argument );
+#endif
@@ -27,7 +27,7 @@
 
 Bank			* bank;
 static pthread_attr_t	kernel_attr;
-static char		buff[512];
+static int		checkpoint_seconds;
 
 /***************************************************************************/
 /* SIGNAL HANDLERS							   */
@@ -36,13 +36,31 @@ static char		buff[512];
 /*
  * Signal handler for SIGINT.
  *
- * When invoked, the bank server will shutdown.
+ * SIGINT is blocked in every thread except while main() waits for it, so
+ * this only sets serverstop and main() shuts the server down.
  */
 static void
 sigint_handler( int signo )
 {
-	printf("SIGINT invoked... server shutting down.\n");
-	_exit( 0 );
+	serverstop = 1;
+}
+
+/*
+ * Gives SIGINT back its default action in a forked session or worker, which
+ * has none of the server's shutdown to do.
+ */
+static void
+sigint_restore( void )
+{
+	struct sigaction	action;
+
+	action.sa_flags = 0;
+	action.sa_handler = SIG_DFL;
+	sigemptyset( &action.sa_mask );
+	sigaction(SIGINT, &action, 0);
+
+	sigaddset( &action.sa_mask, SIGINT );
+	pthread_sigmask( SIG_UNBLOCK, &action.sa_mask, NULL );
 }
 
 /*
@@ -74,171 +92,47 @@ init_sighandlers()
 	action.sa_handler = sigchld_handler;
 	sigemptyset( &action.sa_mask );
 	sigaction(SIGCHLD, &action, 0);
-}
 
-void
-init_addrinfo( struct addrinfo * aiptr )
-{
-	(*aiptr).ai_flags = AI_PASSIVE;
-	(*aiptr).ai_family = AF_INET;
-	(*aiptr).ai_socktype = SOCK_STREAM;
-	(*aiptr).ai_protocol = 0;
-	(*aiptr).ai_addrlen = 0;
-	(*aiptr).ai_canonname = NULL;
-	(*aiptr).ai_next = NULL;
+	/* SIGUSR1 asks for a full report, only printaccounts_thread() takes it */
+	sigaddset( &action.sa_mask, SIGUSR1 );
+	/* SIGINT is taken by main() alone, forked children restore it */
+	sigaddset( &action.sa_mask, SIGINT );
+	pthread_sigmask( SIG_BLOCK, &action.sa_mask, NULL );
+	pthread_atfork( NULL, NULL, sigint_restore );
 }
 
-/***************************************************************************/
-/* UTILITIES 								   */
-/***************************************************************************/
-
-/*
- * Parses the buffer and populates the argument pointer as needed.
- *
- * Returns -1 on error.
- * Returns 0 for open account. Argument is populated with account name.
- * Returns 1 for start account. Argument is populated with account name.
- * Returns 2 for credit account. Argument is populated with amount.
- * Returns 3 for debit account. Argument is populated with amount.
- * Returns 4 for balance. Argument is not populated.
- * Returns 5 for finish. Argument is not populated.
- * Returns 6 for exit. Argument is not populated.
- */
-int
-parseBuffer( char* buff , char * argument){
-	int		end, length,
-			i, truelength, inter, rv;
-	char		* arg1;
-
-	arg1 = NULL;
-	end = length = i = truelength = inter = rv = 0;
-
-	/*Read first argument*/
-
-	for( length = 0 ; ; length++ )
-	{
-		if( buff[length] == '\0' )
-		{
-			end = 1;
-			if( (arg1 = (char *)malloc(sizeof(char)*length)) == NULL)
-			{
-		//		errormessage("malloc() failed");
-				return -1;
-			}
-			strncpy( arg1, buff, length);
-			arg1[length-1] = '\0';			
-			break;		
-		}
-		else if( buff[length] == ' ')
-		{
-			if( (arg1 = (char *)malloc((sizeof(char)*length) + 1)) == NULL)
-			{
-		//		errormessage("malloc() failed");
-				return -1;
-			}
-			strncpy( arg1, buff, length+1);
-			arg1[length] = '\0';
-			break;
-		}
-	}
-	if(arg1 == NULL){
-		printf("arg1 is null\n");
-		return -2;
-	}
-
-
-	inter = length+1;
-
-	/*If second argument exists, read it now, and set value of argument to the read argument*/
-
-	if(end != 1)
-	{
-//		printf("parseBuffer: end != 1\n");
-		truelength = 0;
-//		length = 0;
-		for( length++; ; truelength++)
-		{
-			if( buff[length] == '\n'){
-//				printf("new line character detected yo. length:%d , truelength:%d\n",length,truelength);
-			}
-			if( buff[length] == '\0' ){
-//				printf("null character detected yo. length:%d , truelength:%d\n",length,truelength);
-//				printf("parseBuffer: buff[length] == '\\0'\n");
-
-//				if( ((*argument) = (char *)malloc(sizeof(char)*truelength)) == NULL)
-//				{
-			//		errormessage("malloc() failed");
-//					return -1;
-//				}
-				strncpy( argument, (&buff[inter]), truelength);
-				(argument)[truelength-1] = '\0';			
-				break;		
-			}
-			length++;
-		}		
-	}
-
-	if( strcmp(arg1, "open") == 0)
-	{
-		rv = 0;
-	}
-	else if( strcmp(arg1, "start") == 0)
-	{
-		rv = 1;
-	}
-	else if( strcmp(arg1, "credit") == 0)
-	{
-		rv = 2;
-	}
-	else if( strcmp(arg1, "debit") == 0)
-	{
-		rv = 3;
-	}
-	else if( strcmp(arg1, "balance") == 0)
-	{
-		rv = 4;
-	}
-	else if( strcmp(arg1, "finish") == 0)
-	{
-		rv = 5;
-	}
-	else if( strcmp(arg1, "exit") == 0)
-	{
-		rv = 6;
-	}
-	else
-	{
-		rv = -1;
-	}
-	free(arg1);
-	return rv;
-}
 /***************************************************************************/
 /* BANK ACCOUNT FUNCTIONS						   */
 /***************************************************************************/
 
 /*
- * Initializes a bank struct in shared memory.
+ * Initializes a bank struct in shared memory, sized for maxaccounts
+ * accounts with state records of statesize bytes.  An existing segment
+ * keeps the size and layout it was created with and is refused if its
+ * format does not match this build.  Its locks and sessions are reset.
  *
  * Returns a pointer to the shared memory segment.
  */
 Bank *
-initshmBank()
+initshmBank( int maxaccounts, size_t statesize )
 {
+	struct shmid_ds	info;
 	key_t		key;
-	int		shmid, id, i;
+	int		shmid, id;
 	const char	* path = KEY_PATHNAME;
 	char		* test;
+	Bank		layout;
 	Bank		* bank;
 
 	id = KEY_ID;
+	banklayout( &layout, maxaccounts, statesize );
 
 	if( (key = ftok( path, id )) == -1 )
 	{
 		errormessage("ftok() failed");
 		return 0;
 	}
-	else if ( (shmid = shmget( key, sizeof(Bank), 0666 | IPC_CREAT | IPC_EXCL )) == -1 )
+	else if ( (shmid = shmget( key, bankbytes( &layout, maxaccounts ), 0666 | IPC_CREAT | IPC_EXCL )) == -1 )
 	{
 		if( errno == EEXIST )
 		{
@@ -256,9 +150,23 @@ initshmBank()
 					errormessage("shmat() failed");
 					return 0;
 				}
+				else if ( shmctl(shmid, IPC_STAT, &info) != 0 || bankcheck( (Bank *) test, info.shm_segsz ) != 0 )
+				{
+					printf("Shared memory segment does not match this server, remove it with ipcrm.\n");
+					shmdt(test);
+					return 0;
+				}
+				else if ( bankrelock( (Bank *) test ) != 0 )
+				{
+					/* Locks, waiters and sessions may belong to a crashed server */
+					errormessage("bankrelock() failed");
+					shmdt(test);
+					return 0;
+				}
 				else
 				{
 					bank = (Bank *) test;
+					printf("Bank holds up to %d accounts.\n", bank->maxaccounts);
 					return bank;
 				}
 			}	
@@ -276,102 +184,94 @@ initshmBank()
 			errormessage("shmat() failed");
 			return 0;
 		}
+		else if ( initBank( (Bank *) test, maxaccounts, statesize ) != 0 )
+		{
+			return 0;
+		}
 		else{
+			/* The whole segment is allocated up front */
 			bank = (Bank *) test;
-			bank->numaccounts = 0;
-			if ( pthread_mutex_init( &bank->bankmutex, NULL ) != 0 )
-			{
-				errormessage("pthread_mutex_init() failed");
-				return 0;
-			}	
-			for ( i = 0; i < 20; i++ )
-			{
-				/* accountname is left empty, strlen(accountname) == 0 means empty account */
-				bank->accounts[i].currentbalance = 0.0;
-				bank->accounts[i].insession = 0;  
-				if ( pthread_mutex_init( &bank->accounts[i].clientsession_mutex, NULL ) != 0 )
-				{
-					errormessage("pthread_mutex_init() failed");
-					return 0;
-				}	
-				else if ( pthread_mutex_init( &bank->accounts[i].updateinfo_mutex, NULL ) != 0 )
-				{
-					errormessage("pthread_mutex_init() failed");
-					return 0;
-				}	
-			}	
-			printf("Bank initialized.\n");
+			bank->capacity = maxaccounts;
 			return bank;
 		}
 	}
 
 }
 /*
- * Initializes a bank struct.
+ * Initializes the header of a bank able to hold up to maxaccounts
+ * accounts with state records of statesize bytes.  The index must already
+ * be zeroed.  Accounts are initialized
+ * by openaccount() as they are used.
+ *
+ * Returns 0 on success, -1 otherwise.
  */
 int
-initBank( Bank * bank )
+initBank( Bank * bank, int maxaccounts, size_t statesize )
 {
-	int	i;
+	banklayout( bank, maxaccounts, statesize );
 	bank->numaccounts = 0;
-	if ( pthread_mutex_init( &bank->bankmutex, NULL ) != 0 )
+	bank->capacity = 0;
+	bank->arenaused = 0;
+	if ( banklock_init( &bank->bankmutex ) != 0 )
 	{
-		errormessage("pthread_mutex_init() failed");
-		return 0;
-	}	
-	for ( i = 0; i < 20; i++ )
-	{
-		/* accountname is left empty, strlen(accountname) == 0 means empty account */
-		bank->accounts[i].currentbalance = 0.0;
-		bank->accounts[i].insession = 0;  
-		if ( pthread_mutex_init( &bank->accounts[i].clientsession_mutex, NULL ) != 0 )
-		{
-			errormessage("pthread_mutex_init() failed");
-			return 0;
-		}	
-		else if ( pthread_mutex_init( &bank->accounts[i].updateinfo_mutex, NULL ) != 0 )
-		{
-			errormessage("pthread_mutex_init() failed");
-			return 0;
-		}	
+		errormessage("banklock_init() failed");
+		return -1;
 	}	
-	printf("Bank initialized.\n");
+	printf("Bank initialized for up to %d accounts.\n", maxaccounts);
 	return 0;
 }
 
 /*
- * Prints information regarding all open bank accounts.
+ * Prints information regarding the open bank accounts: all of them if
+ * full is set, else only those changed since the last report.  The
+ * balances are captured as of one point in time without holding off
+ * sessions, and printed with no lock held.
  */
 void
-printBank( Bank * bank )
+printBank( Bank * bank, int full )
 {
-	int	i;
-	pthread_mutex_lock( &bank->bankmutex ); //Printing bank, lock.
-	if ( bank->numaccounts == 0 )
+	int64_t	* balances, sum;
+	int	* ids, i, n, open;
+	char	total[AMOUNT_STRLEN];
+
+	open = __atomic_load_n( &bank->numaccounts, __ATOMIC_ACQUIRE );
+	if ( (ids = (int *) malloc((open + 1) * sizeof(int))) == NULL )
+	{
+		errormessage("malloc() failed");
+		return;
+	}
+	/* Clear the marks first, a change made while printing is reported next time */
+	n = dirtytake( ids, open );
+	if ( (balances = bankcapture( bank, full ? NULL : ids, &n )) == NULL )
+	{
+		free(ids);
+		return;
+	}
+	else if ( n == 0 && open == 0 )
 	{
 		printf("There are no open accounts at the moment.\n");
 	}
-	else
+	else if ( full )
 	{
-		/* loop through and lock update info every account */
-		for( i = 0; i < bank->numaccounts; i++ )
-		{
-			//Printing info, lock accounts from updating.
-			pthread_mutex_lock(&bank->accounts[i].updateinfo_mutex);
-		}
-		for( i = 0; i < bank->numaccounts; i++ )
+		for( sum = 0, i = 0; i < n; i++ )
 		{
-			accountprint(&bank->accounts[i]);
+			accountprint(bankaccount( bank, i ), bankname( bank, i ), balances[i],
+				__atomic_load_n( bankflags( bank, i ), __ATOMIC_RELAXED ) & ACCOUNT_INSESSION);
+			sum += balances[i];
 		}
-
-		/* loop through and unlock update info every account */
-		for( i = 0; i < bank->numaccounts; i++ )
+		printf("Total of %d accounts -- %s\n", n, formatamount( sum, total ));
+	}
+	else
+	{
+		for( i = 0; i < n; i++ )
 		{
-			//Done printing info, unlock accounts for updating.
-			pthread_mutex_unlock(&bank->accounts[i].updateinfo_mutex);
+			accountprint(bankaccount( bank, ids[i] ), bankname( bank, ids[i] ), balances[i],
+				__atomic_load_n( bankflags( bank, ids[i] ), __ATOMIC_RELAXED ) & ACCOUNT_INSESSION);
 		}
+		printf("%d of %d accounts changed since the last report\n", n, open);
 	}
-	pthread_mutex_unlock( &bank->bankmutex ); //Done printing, unlock.
+	free(balances);
+	free(ids);
 }
 
 /*
@@ -383,37 +283,38 @@ printBank( Bank * bank )
 int
 openaccount( char * name)
 {
-	int	i;
-	if ( bank->numaccounts == 20 )
+	int	id, rv;
+
+	rv = 0;
+	banklock( &bank->bankmutex ); //Adding account, lock.
+	if ( bank->numaccounts == bank->capacity )
 	{
-		printf("Could not create account: Bank is full.\n");
-		return -1;
+		logevent( LOG_BANKFULL, 0, 0, NULL, 0 );
+		rv = -1;
+	}
+	else if ( bankindex_find( bank, name ) != -1 )
+	{
+		logevent( LOG_EXISTS, 0, 0, NULL, 0 );
+		rv = -2;
 	}
 	else
 	{
-		for ( i = 0; i < bank->numaccounts; i ++ )
-		{
-			if ( strcmp(bank->accounts[i].accountname, name) == 0 )
-			{
-				printf("An account with that name already exists.\n");
-				return -2;
-			}
-		}
-		
-		pthread_mutex_lock( &bank->bankmutex ); //Adding account, lock.
-		if ( strncpy(bank->accounts[bank->numaccounts].accountname, name, 100) == NULL )
+		id = bank->numaccounts;
+		if ( bankinitaccount( bank, id, name ) != 0 || bankindex_insert( bank, id ) != 0
+			|| walappend( WAL_OPEN, id, 0, name ) != 0 )
 		{
 			errormessage("Could not create account");
-			return -3;
+			rv = -3;
 		}
 		else
 		{
-			printf("Account %d: %s successfully created.\n", (bank->numaccounts + 1), name);
-			bank->numaccounts++;
+			logevent( LOG_OPENED, id + 1, 0, name, strlen(name) );
+			__atomic_store_n( &bank->numaccounts, id + 1, __ATOMIC_RELEASE );
+			dirtymark( id );
 		}
-		pthread_mutex_unlock( &bank->bankmutex ); //Done adding, unlock.
 	}
-	return 0;
+	bankunlock( &bank->bankmutex ); //Done adding, unlock.
+	return rv;
 }
 
 /* Given a name, returns the ID (or index) of the account.
@@ -423,34 +324,27 @@ openaccount( char * name)
 int
 getIDfromname( char * accountname )
 {
-	int	i;
 	if (accountname == NULL)
 	{
 		return -1;
 	}	
 	else
 	{
-		for ( i = 0; i < bank->numaccounts; i++ )
-		{
-			if ( strcmp(bank->accounts[i].accountname, accountname) == 0 )
-			{
-				return i;
-			}
-		} 
-//		printf("Account does not exist.\n");
-		return -1;
+		return bankindex_find( bank, accountname );
 	}
 }
 
 /*
- * Credits the bank account with the given amount.
+ * Credits the bank account with the given amount of cents.  The overflow
+ * check and the addition are a single compare-and-swap, no lock is taken.
  *
- * Returns 0 on success, -1 otherwise.
+ * Returns 0 on success, -1 on error, -3 if the balance would overflow.
  */
 int
-creditaccount( float amount, char * accountname )
+creditaccount( int64_t amount, char * accountname )
 {
-	int i;
+	int		i;
+	int64_t		balance;
 	
 	if ( (i = getIDfromname(accountname)) == -1 )
 	{
@@ -458,53 +352,64 @@ creditaccount( float amount, char * accountname )
 	}
 	else if ( amount < 0 )
 	{
-		printf("Cannot credit a negative amount.\n");
+		logevent( LOG_NEGATIVE, COMMAND_CREDIT, 0, NULL, 0 );
 		return -1;
 	}
+	else if ( bankcredit( bank, i, amount, &balance ) != 0 )
+	{
+		logevent( LOG_OVERFLOW, 0, 0, NULL, 0 );
+		return -3;
+	}
 	else
 	{
-		pthread_mutex_lock( &bank->accounts[i].updateinfo_mutex );
-		bank->accounts[i].currentbalance += amount;
-		printf("Credit successful, current balance: %.2f\n", bank->accounts[i].currentbalance);
-		pthread_mutex_unlock( &bank->accounts[i].updateinfo_mutex );
+		logevent( LOG_CREDITED, 0, balance, NULL, 0 );
 	}
 	return 0;
 }
 
 /*
- * Debits the bank account with the given amount.
+ * Debits the bank account with the given amount of cents.  The funds check
+ * and the subtraction are a single compare-and-swap, no lock is taken.
+ *
+ * Returns 0 on success, -1 on error, -2 for insufficient funds.
  */
 int
-debitaccount( float amount, char * accountname )
+debitaccount( int64_t amount, char * accountname )
 {
-	int i;
+	int		i;
+	int64_t		balance;
 	
 	if ( (i = getIDfromname(accountname)) == -1 )
 	{
 		return -1;
 	}
-	else if ( amount > bank->accounts[i].currentbalance )
+	else if ( amount < 0 )
 	{
-		printf("Insufficient funds.\n");
+		logevent( LOG_NEGATIVE, COMMAND_DEBIT, 0, NULL, 0 );
+		return -1;
+	}
+	else if ( bankdebit( bank, i, amount, &balance ) != 0 )
+	{
+		logevent( LOG_NOFUNDS, 0, 0, NULL, 0 );
 		return -2;
 	}
 	else
 	{
-		pthread_mutex_lock( &bank->accounts[i].updateinfo_mutex );
-		bank->accounts[i].currentbalance -= amount;
-		printf("Debit successful, current balance: %.2f\n", bank->accounts[i].currentbalance);
-		pthread_mutex_unlock( &bank->accounts[i].updateinfo_mutex );
+		logevent( LOG_DEBITED, 0, balance, NULL, 0 );
 	}
 	return 0;
 }
 
 /*
- * Returns the current balance for the given bank account.
+ * Returns the current balance, in cents, for the given bank account.
+ *
+ * Returns -1 if not found.
  */
-float
+int64_t
 accountbalance( char * accountname )
 {
-	int i;
+	int		i;
+	int64_t		balance;
 	
 	if ( (i = getIDfromname(accountname)) == -1 )
 	{
@@ -512,12 +417,10 @@ accountbalance( char * accountname )
 	}
 	else
 	{
-		pthread_mutex_lock( &bank->accounts[i].updateinfo_mutex );
-		printf("Current balance for %s: %.2f\n", accountname, bank->accounts[i].currentbalance);
-		pthread_mutex_unlock( &bank->accounts[i].updateinfo_mutex );
-		return bank->accounts[i].currentbalance;
+		balance = __atomic_load_n( bankbalance( bank, i ), __ATOMIC_SEQ_CST );
+		logevent( LOG_BALANCE, 0, balance, accountname, strlen(accountname) );
+		return balance;
 	}
-	return 0;
 }
 
 /***************************************************************************/
@@ -525,277 +428,103 @@ accountbalance( char * accountname )
 /***************************************************************************/
 
 /*
- * Thread that prints all bank accounts every 20 seconds.
+ * Waits up to seconds for a SIGUSR1.
+ *
+ * Returns 1 if one came, 0 otherwise.
+ */
+static int
+reportwait( int seconds )
+{
+	struct timespec		remaining;
+	sigset_t		request;
+	time_t			deadline;
+
+	sigemptyset( &request );
+	sigaddset( &request, SIGUSR1 );
+	for ( deadline = time(NULL) + seconds; (remaining.tv_sec = deadline - time(NULL)) > 0; )
+	{
+		remaining.tv_nsec = 0;
+		if ( sigtimedwait( &request, NULL, &remaining ) == SIGUSR1 )
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Thread that prints the bank accounts changed in the last 20 seconds, the
+ * command latencies and, with -p, the lock profiles every 20 seconds.
+ * Every account is printed at startup and on SIGUSR1.
  */
 void *
 printaccounts_thread( void * ignore )
+{
+	char		report[STATS_REPORTMAX];
+	char		locks[LOCKPROF_REPORTMAX];
+	int		full;
+
+	pthread_detach( pthread_self() );
+	for ( full = 1; ; full = reportwait( 20 ) )
+	{
+		printBank(bank, full);
+		statsreport( report, sizeof(report) );
+		lockprof_report( locks, sizeof(locks) );
+		printf("%s%s", report, locks);
+	}
+}
+
+/*
+ * Thread that writes the log records of every session process to stdout
+ * every LOG_DRAIN_MS milliseconds.
+ */
+void *
+logger_thread( void * ignore )
 {
 	pthread_detach( pthread_self() );
 	while(1)
 	{
-		printBank(bank);
-		sleep(20);
+		logdrain();
+		usleep(LOG_DRAIN_MS * 1000);
+	}
+}
+
+/*
+ * Thread that writes a snapshot of the bank every checkpoint_seconds
+ * seconds.
+ */
+void *
+checkpoint_thread( void * ignore )
+{
+	pthread_detach( pthread_self() );
+	while(1)
+	{
+		sleep(checkpoint_seconds);
+		banksnapshot( bank, SNAPSHOT_PATH );
 	}
 }
 
 /*
  * Client session thread. Argument is pointer to socket descriptor.
  *
- * This thread fork()s for every connection.
+ * This thread runs in the child fork()ed for its connection.
  */
 void *
 client_service_thread( void * sdptr )
 {
-	int			sd, rv, id;
-	float		balance;
-	char			  argument[256];
-	char			  currAccount[100];
-	char			  balancefloat[100];
-	char			  errorstatement[60];
-	int			asflag;
-	//char			* func = "client service thread";
+	Session			session;
 
 	pthread_detach( pthread_self() ); // don't wait for me
 
-	strcpy(errorstatement,"There was an error in your request. Please try again");
-
-	sd = *(int *) sdptr; // get that argument
+	sessioninit( &session, *(int *) sdptr, 1 ); // get that argument
 	free(sdptr); // covenant
 
-	id = 0;
-	rv = 0;
-	asflag = 0;
-
-	bzero( argument, sizeof(argument));
-	bzero( currAccount, sizeof(currAccount));
-	bzero( balancefloat, sizeof(balancefloat));
-
-	printf("Connection established\n");
-	bzero(buff, sizeof(buff));
-	write(sd, "Enter command: ", sizeof("Enter command: "));
-	while(read(sd,buff,sizeof(buff)) != 0)
-	{
-		bzero( argument, sizeof(argument));
-		write(1, "client entered:", sizeof("client entered:"));
-		write(1, buff, sizeof(buff));
-		rv = parseBuffer( buff, argument );
-		switch (rv)
-		{
-			case 0: // open account - requires argument
-				if( asflag != 1 )
-				{
-					if( ( id = openaccount( argument ) ) == -1 )
-					{
-						write(sd, "Could not create account: Bank is full.\n", sizeof("Could not create account: Bank is full.\n"));
-					}
-					else if( id == -2)
-					{
-						write(sd, "An account with that name already exists.\n", sizeof("An account with that name already exists.\n"));
-					}
-					else if( id == -3)
-					{
-						write(sd, "Could not create account", sizeof("Could not create account"));
-					}
-					else
-					{
-						write(sd, "Account successfully opened for: ", sizeof("Account successfully opened for: "));
-						write(sd, argument, sizeof(argument));
-						write(sd, "\n", sizeof("\n"));						
-					}
-			//		free(argument);
-				}
-				else
-				{
-					printf("Currently in session\n");
-					write(sd, "Account currently in session\n", sizeof("Account currently in session\n"));
-					write(sd, "\n", sizeof("\n"));
-				}
-				break;
-			case 1: // start account - requires argument, sets account started flag.
-				if( asflag != 1 )
-				{
-					if( ( id = getIDfromname( argument ) ) == -1)
-					{
-						write(sd, "Account does not exist.\n", sizeof("Account does not exist.\n"));
-					}
-					else
-					{
-						//if( bank->accounts[id].insession == 1){
-							//
-						//	while(bank->accounts[id].insession == 1)
-							while (pthread_mutex_trylock(&bank->accounts[id].clientsession_mutex) != 0)
-							{
-							printf("Currently in session\n");
-							write(sd, "Account currently in session\n", sizeof("Account currently in session\n"));
-							sleep(2);
-							write(sd, "Trying to connect again\n", sizeof("Trying to connect again\n"));
-							}
-						//}
-
-						asflag = 1;
-						strcpy(currAccount , argument);
-				//		currAccount[(strlen(argument))] = "\0";
-						
-						bank->accounts[id].insession = 1;
-
-						printf("Session starting for: \n");
-						write(sd, "Session starting for: ", sizeof("Session starting for: "));
-						write(sd, argument, sizeof(argument));
-						write(sd, "\n", sizeof("\n"));						
-					}
-
-			//		free(argument);
-				}	
-				else
-				{
-					printf("Currently in session\n");
-					write(sd, "Account currently in session\n", sizeof("Account currently in session\n"));
-					write(sd, "\n", sizeof("\n"));
-				}	
-				break;
-			case 2: // credit account - requires argument and account started flag.
-				if( asflag != 1 )
-				{
-					printf("Need to be in session\n");
-					write(sd, "Account must be in session first\n", sizeof("Account must be in session first\n"));
-					write(sd, "\n", sizeof("\n"));
-				}
-				else
-				{
-					if( (id = creditaccount( atof( argument ), currAccount ) ) == -1 )
-					{
-						write(sd, "Crediting went wrong\n", sizeof( "Crediting went wrong\n" ));
-					}
-					else
-					{
-						printf("Crediting account\n");
-						write(sd, "Crediting account: $", sizeof("Crediting account: $"));
-						write(sd, argument, sizeof(argument));
-						write(sd, "\n", sizeof("\n"));
-					}
-			//		free(argument);
-				}
-				break;
-			case 3: // debit account - requires argument and account started flag.
-				if( asflag != 1 )
-				{
-					printf("Need to be in session\n");
-					write(sd, "Account must be in session first\n", sizeof("ccount must be in session first\n"));
-					write(sd, "\n", sizeof("\n"));
-				}
-				else
-				{
-					if( (id = debitaccount( atof( argument ), currAccount ) ) == -1 )
-					{
-						write(sd, "Debiting went wrong\n", sizeof( "Debiting went wrong\n" ));
-						write(sd, "\n", sizeof("\n"));
-					}
-					else if(id == -2)
-					{
-						write(sd, "Insufficient funds.\n", sizeof("Insufficient funds.\n"));
-						write(sd, "\n", sizeof("\n"));
-					}
-					else
-					{
-						printf("Debiting account\n");
-						write(sd, "Debiting account: $", sizeof("Debiting account: $"));
-						write(sd, argument, sizeof(argument));
-						write(sd, "\n", sizeof("\n"));						
-					}					
-			//		free(argument);
-				}
-				break;
-			case 4: // account balance - requires argument and account started flag.
-				if( asflag != 1 )
-				{
-					printf("Need to be in session\n");
-					write(sd, "Account must be in session first\n", sizeof("ccount must be in session first\n"));
-					write(sd, "\n", sizeof("\n"));
-				}
-				else
-				{
-					if( (balance = accountbalance( currAccount ) ) == -1)
-					{
-						write(sd, "Checking account balance went wrong\n", sizeof("Checking account balance went wrong\n") );
-					}
-					else
-					{
-						printf("Printing account balance\n");
-						write(sd, "Printing account balance: $", sizeof("Printing account balance: $"));
-						sprintf(balancefloat,"%.2f", balance);
-						write(sd, balancefloat, sizeof(balancefloat));
-						write(sd, "\n", sizeof("\n"));
-						bzero(balancefloat, sizeof(balancefloat));						
-					}
-
-				}
-				break;
-			case 5: // finish - requires acount started flags, resets flag.
-				if( asflag != 1 )
-				{
-					printf("Need to be in session\n");
-					write(sd, "Account must be in session first\n", sizeof("ccount must be in session first\n"));
-					write(sd, "\n", sizeof("\n"));
-				}
-				else
-				{
-					if( ( id = getIDfromname( currAccount ) ) == -1)
-					{
-						write(sd, "Something went wrong with finish\n", sizeof("Something went wrong with finish\n"));
-						write(sd, "\n", sizeof("\n"));
-					}
-					else
-					{
-						if ( pthread_mutex_unlock( &bank->accounts[id].clientsession_mutex ) != 0 )
-						{
-							write(sd,"pthread_mutex_unlock() failed\n", sizeof("pthread_mutex_unlock() failed\n"));
-							write(sd, "\n", sizeof("\n"));
-							return 0;
-						}
-						else
-						{ 
-							bank->accounts[id].insession = 0;
-							printf("Ending session now\n");
-							write(sd, "Ending session now\n", sizeof("Ending session now\n"));
-							write(sd, "\n", sizeof("\n"));
-							asflag = 0;
-							bzero(currAccount, sizeof(currAccount));							
-						}
-						
-					}
-				}
-				break;
-						
-
-			case 6: // exit - can be called whenever, writes 0 to client.
-		/*		if ( phtread_mutex_unlock( &bank->accounts[id].clientsession_mutex ) != 0 )
-				{
-					write(sd,"pthread_mutex_unlock() failed", sizeof("pthread_mutex_unlock() failed"));
-					return 0;
-				}	 */			
-				if( ( id = getIDfromname( currAccount ) ) != -1)
-				{
-					//Calling exit while inside a session
-					bank->accounts[id].insession = 0;
-					printf("Ending session now\n");
-					write(sd, "Ending session now\n", sizeof("Ending session now\n"));
-					asflag = 0;
-					bzero(currAccount, sizeof(currAccount));
-				}
-				write(sd, "Exiting. Thank you for using the bank of JuJu\n", sizeof("Exiting. Thank you for using the bank of JuJu\n"));
-				exit(0);			
-			default: // error, report back to client
-//				write(sd, errorstatement, sizeof(buff));
-				write(sd, "There was an error processing your request\n", sizeof("There was an error processing your request\n"));
-				write(sd, "\n", sizeof("\n"));
-				break;
-		}
-		bzero(buff,sizeof(buff));
-		write(sd, "Enter command: ", sizeof("Enter command: "));
-	}	
-		bzero(buff,sizeof(buff)); 
-	exit(0);	
-
+	logevent( LOG_CONNECTED, 0, 0, NULL, 0 );
+	sessionprompt( &session );
+	sessionflush( &session );
+	while( sessioninput( &session ) != SESSION_EXIT );
+	sessionclose( &session );
+	exit(0);
 }
 
 /*
@@ -849,7 +578,7 @@ forking_thread( void * fdptr )
 	/*** PARENT PROCESS ***/
 	{
 //		printf("PARENT: Parent process with PID: %d\n", getpid());
-		printf("[PID - %d]: Created child process with [PID - %d]\n", getpid(), pid);
+		logevent( LOG_FORKED, getpid(), pid, NULL, 0 );
 		close(fd);
 //		printf("PARENT: Exiting this thread now\n");
 		pthread_exit(0);
@@ -867,42 +596,17 @@ forking_thread( void * fdptr )
 void *
 session_acceptor_thread( void * ignore )
 {
-	struct addrinfo		hints,
-				* result;
 	struct sockaddr_in	senderAddr;
-	int			sockfd, fd, on, error;
+	int			sockfd, fd;
 	int 			*fdptr;
 	socklen_t		size;
 	pthread_t		tid;
 	//char			* func = "session acceptor thread";
 
 	pthread_detach( pthread_self() );
-	init_addrinfo(&hints);
-	on = 1;
 
-	if ( (error = getaddrinfo(NULL, PORT_NUMBER, &hints, &result)) != 0 )
-	{
-		errormessage("getaddrinfo() failed");
-		return 0;
-	}
-	else if ( (sockfd = socket(result->ai_family, result->ai_socktype, result->ai_protocol)) == -1 )
-	{
-		errormessage("socket() failed");
-		return 0;
-	}
-	else if ( (error = setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on))) != 0 )
-	{
-		errormessage("setsockopt() failed");
-		return 0;
-	}
-	else if ( (error = bind(sockfd, result->ai_addr, result->ai_addrlen)) != 0 )
-	{
-		errormessage("bind() failed");
-		return 0;
-	} 
-	else if ( (error = listen(sockfd, 100)) != 0 )
+	if ( (sockfd = init_listener( PORT_NUMBER, 0 )) == -1 )
 	{
-		errormessage("listen() failed");
 		return 0;
 	}
 	else
@@ -920,9 +624,7 @@ session_acceptor_thread( void * ignore )
 			{
 				fdptr = (int *)malloc(sizeof(int));
 				*fdptr = fd;	
-				printf("======================\n");
-				printf("Connection established\n");
-				printf("======================\n");
+				logevent( LOG_ACCEPTED, 0, 0, NULL, 0 );
 				if( pthread_create( &tid, &kernel_attr, forking_thread, fdptr) != 0 )
 				{
 					errormessage("pthread_create() failed");
@@ -943,20 +645,117 @@ session_acceptor_thread( void * ignore )
 /***************************************************************************/
 
 int
-main()
+main( int argc, char ** argv )
 {
 	pthread_t		tid;
+	sigset_t		interrupt;
+	size_t			statesize;
+	int			c, eventmode, profilelocks, nworkers, maxaccounts, sockfd, level, signo;
 	//char			* func = "server main";
 
+	eventmode = profilelocks = nworkers = 0;
+	level = LOGLEVEL_DEBUG;
+	maxaccounts = BANK_DEFAULT_ACCOUNTS;
+	statesize = BANK_STATE_DENSE;
+	while ( (c = getopt(argc, argv, "emw:c:l:k:pL:")) != -1 )
+	{
+		switch ( c )
+		{
+			case 'e': // serve every connection from one epoll event loop
+				eventmode = 1;
+				break;
+			case 'm': // sessions start in machine mode
+				sessiondefaultmode = SESSION_MACHINE;
+				break;
+			case 'p': // profile lock contention
+				profilelocks = 1;
+				break;
+			case 'w': // pre-fork() this many event loop workers
+				nworkers = atoi(optarg);
+				break;
+			case 'c': // maximum number of accounts in a new bank
+				if ( (maxaccounts = atoi(optarg)) < 1 )
+				{
+					printf("Invalid number of accounts: %s\n", optarg);
+					return 0;
+				}
+				break;
+			case 'l': // layout of the account state in a new bank
+				if ( strcmp(optarg, "padded") == 0 )
+				{
+					statesize = BANK_STATE_PADDED;
+				}
+				else if ( strcmp(optarg, "dense") == 0 )
+				{
+					statesize = BANK_STATE_DENSE;
+				}
+				else
+				{
+					printf("Invalid layout: %s\n", optarg);
+					return 0;
+				}
+				break;
+			case 'L': // log session events up to this level
+				if ( strcmp(optarg, "warn") == 0 )
+				{
+					level = LOGLEVEL_WARN;
+				}
+				else if ( strcmp(optarg, "info") == 0 )
+				{
+					level = LOGLEVEL_INFO;
+				}
+				else if ( strcmp(optarg, "debug") == 0 )
+				{
+					level = LOGLEVEL_DEBUG;
+				}
+				else
+				{
+					printf("Invalid log level: %s\n", optarg);
+					return 0;
+				}
+				break;
+			case 'k': // write a snapshot this often
+				if ( (checkpoint_seconds = atoi(optarg)) < 1 )
+				{
+					printf("Invalid checkpoint interval: %s\n", optarg);
+					return 0;
+				}
+				break;
+			default:
+				printf("Usage: %s [-e] [-m] [-w workers] [-c accounts] [-l dense|padded] [-k seconds] [-p] [-L warn|info|debug]\n", argv[0]);
+				return 0;
+		}
+	}
+
 	/* Initialize signal handlers */
 	init_sighandlers();
 
 		/*** Real main stuff ***/
-	if( (bank = initshmBank()) == NULL )
+	if( (bank = initshmBank( maxaccounts, statesize )) == NULL )
 	{
 		errormessage("Failed to inittialize bank");
 		return 0;
 	}
+	else if ( statsinit() != 0 )
+	{
+		errormessage("Failed to initialize statistics");
+		return 0;
+	}
+	else if ( dirtyinit( bank->maxaccounts ) != 0 )
+	{
+		errormessage("Failed to initialize report tracking");
+		return 0;
+	}
+	else if ( loginit( level ) != 0 )
+	{
+		errormessage("Failed to initialize the log");
+		return 0;
+	}
+	else if ( profilelocks && lockprof_init( bank ) != 0 )
+	{
+		errormessage("Failed to initialize lock profiling");
+		return 0;
+	}
 	else if( pthread_attr_init( &kernel_attr ) != 0 )
 	{
 		errormessage("pthread_attr_init() failed");
@@ -967,12 +766,35 @@ main()
 		errormessage("pthread_attr_setscope() failed");
 		return 0;
 	}	
-	else if ( pthread_create( &tid, &kernel_attr, session_acceptor_thread, 0) != 0)
+	else if ( pthread_create( &tid, &kernel_attr, printaccounts_thread, 0) != 0)
 	{
 		errormessage("pthread_create() failed");
 		return 0;
 	}
-	else if ( pthread_create( &tid, &kernel_attr, printaccounts_thread, 0) != 0)
+	else if ( pthread_create( &tid, &kernel_attr, logger_thread, 0) != 0)
+	{
+		errormessage("pthread_create() failed");
+		return 0;
+	}
+	else if ( checkpoint_seconds > 0 && pthread_create( &tid, &kernel_attr, checkpoint_thread, 0) != 0)
+	{
+		errormessage("pthread_create() failed");
+		return 0;
+	}
+	else if ( nworkers > 0 )
+	{
+		workerpool( PORT_NUMBER, nworkers );
+	}
+	else if ( eventmode )
+	{
+		if ( (sockfd = init_listener( PORT_NUMBER, 0 )) == -1 )
+		{
+			errormessage("Failed to initialize listener");
+			return 0;
+		}
+		eventloop( sockfd );
+	}
+	else if ( pthread_create( &tid, &kernel_attr, session_acceptor_thread, 0) != 0)
 	{
 		errormessage("pthread_create() failed");
 		return 0;
@@ -980,9 +802,18 @@ main()
 	else
 	{
 		printf("Thread successfully created.\n");
-		pthread_exit(0);
+		sigemptyset( &interrupt );
+		sigaddset( &interrupt, SIGINT );
+		while ( sigwait( &interrupt, &signo ) != 0 );
+		serverstop = 1;
+	}
+
+	if ( serverstop )
+	{
+		logdrain();
+		printf("SIGINT invoked... server shutting down.\n");
+		return 0;
 	}
-		
 	printf("Normal end\n");
 	return 0;
 }
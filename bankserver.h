@@ -1,5 +1,6 @@
 #ifndef BANKSERVER_H
 #define BANKSERVER_H
+#define _GNU_SOURCE	/* fallocate() */
 #define errormessage(x) errormessage_(x, __FILE__, __LINE__)
 /*
  * bankserver.h
@@ -10,26 +11,77 @@
 #include <sys/time.h>
 #include <stdlib.h>
 #include "errormessage.c"
+#include "bankcrc.h"
 #include "bankaccount.c"
+#include "bankstore.h"
+#include "bankarena.h"
+#include "bankwal.h"
+#include "bankflush.h"
+#include "bankdirty.h"
+#include "banksnapshot.h"
+#include "bankindex.h"
+#include "bankparse.h"
+#include "bankstats.h"
+#include "banklog.h"
+#include "banklockprof.h"
+#include "bankframe.h"
+#include "banksession.h"
+#include "bankevent.h"
 
+/*
+ * The header of the bank in shared memory.  The page checksums, the name
+ * index, the name arena, the account state records and the accounts
+ * follow it at the given offsets, see bankstore.c.
+ * The fields up to formatcrc describe the format; state is BANK_CLOSED
+ * only while no server has the bank attached after a clean shutdown.
+ *
+ * capacity is the number of accounts currently backed by memory, at most
+ * maxaccounts.  arenaused is the number of bytes of the name arena in
+ * use.  snapepoch is odd while a snapshot is being taken, see
+ * banksnapshot.c.
+ */
 struct Bank_{
+	char			magic[8];
+	uint32_t		version;
+	uint32_t		accountsize;
+	uint32_t		statesize;
+	uint32_t		pagesize;
+	uint32_t		pages;
+	uint32_t		formatcrc;
+	uint32_t		state;
 	int			numaccounts;
-	Account			accounts[20];
+	int			capacity;
+	int			maxaccounts;
+	unsigned int		indexsize;
+	size_t			checksumoffset;
+	size_t			indexoffset;
+	size_t			arenaoffset;
+	size_t			arenasize;
+	size_t			stateoffset;
+	size_t			accountsoffset;
+	size_t			arenaused;
+	unsigned int		snapepoch;
 	pthread_mutex_t		bankmutex;
+	BankWal			wal;
 };
 typedef struct Bank_ Bank;
 
 /*
- * Initializes a bank struct.
+ * Initializes the header of a bank able to hold up to maxaccounts
+ * accounts with AccountState records of statesize bytes.  The index must
+ * already be zeroed.
+ *
+ * Returns 0 on success, -1 otherwise.
  */
 int
-initBank( Bank * bank );
+initBank( Bank * bank, int maxaccounts, size_t statesize );
 
 /*
- * Prints the information regarding all open bank accounts.
+ * Prints the information regarding all open bank accounts if full is set,
+ * else regarding those changed since the last report.
  */
 void
-printBank( Bank * bank );
+printBank( Bank * bank, int full );
 /*
  * Opens a bank account with the given name.
  * If bank is full or name already exists, return -1.
@@ -48,28 +100,41 @@ int
 getIDfromname( char * accountname );
 
 /*
- * Credits the bank account with the given amount.
+ * Credits the bank account with the given amount of cents.
  */
 int
-creditaccount( float amount, char * accountname );
+creditaccount( int64_t amount, char * accountname );
 
 /*
- * Debits the bank account with the given amount.
+ * Debits the bank account with the given amount of cents.
  */
 int
-debitaccount( float amount, char * accountname );
+debitaccount( int64_t amount, char * accountname );
 
 /*
- * Returns the current balance for the given bank account.
+ * Returns the current balance, in cents, for the given bank account.
  */
-float
+int64_t
 accountbalance( char * accountname );
 
-/*
- * Parses the buffer and populates pointers as needed
- */
-int
-parseBuffer( char* buff , char * argument);
+extern Bank		* bank;
 
+#include "bankcrc.c"
+#include "bankamount.c"
+#include "banklock.c"
+#include "bankstore.c"
+#include "bankwal.c"
+#include "bankflush.c"
+#include "bankdirty.c"
+#include "banksnapshot.c"
+#include "bankindex.c"
+#include "bankarena.c"
+#include "bankparse.c"
+#include "bankstats.c"
+#include "banklog.c"
+#include "banklockprof.c"
+#include "bankframe.c"
+#include "banksession.c"
+#include "bankevent.c"
 
 #endif
@@ -0,0 +1,1165 @@
+/*
+ * banksession.c
+ * Authors:	Emmanuel Baah
+ * 		Yuk Yan
+ *
+ * Command handling for one client session.  Shared by the fork()ing
+ * client_service_thread and the epoll event loop so that both speak exactly
+ * the same protocol.
+ */
+#include "banksession.h"
+
+int		sessiondefaultmode = SESSION_TEXT;
+
+/*
+ * Initializes a session for the given socket descriptor.
+ */
+void
+sessioninit( Session * session, int sd, int blocking )
+{
+	bzero( session, sizeof(Session) );
+	session->sd = sd;
+	session->blocking = blocking;
+	session->waitid = -1;
+	session->mode = sessiondefaultmode;
+}
+
+/*
+ * Appends length bytes to the session's reply, flushing first if they do
+ * not fit.
+ */
+void
+sessionreply( Session * session, const char * data, int length )
+{
+	int		n;
+
+	while ( length > 0 )
+	{
+		if ( session->outlen == SESSION_OUTBUF )
+		{
+			sessionflush( session );
+		}
+		n = SESSION_OUTBUF - session->outlen < length ? SESSION_OUTBUF - session->outlen : length;
+		memcpy(session->outbuf + session->outlen, data, n);
+		session->outlen += n;
+		data += n;
+		length -= n;
+	}
+}
+
+/*
+ * Sends length bytes of data to the client, up to what the socket takes
+ * without blocking for event loop sessions.
+ *
+ * Returns the number of bytes sent, -1 if the client is gone.
+ */
+static int
+sessionsend( Session * session, const char * data, int length )
+{
+	int		sent, n;
+
+	for ( sent = 0; sent < length; sent += n )
+	{
+		if ( (n = send(session->sd, data + sent, length - sent, MSG_NOSIGNAL)) != -1 )
+		{
+			continue;
+		}
+		else if ( errno == EAGAIN || errno == EWOULDBLOCK )
+		{
+			return sent;
+		}
+		else if ( errno != EINTR )
+		{
+			return -1;
+		}
+		n = 0;
+	}
+	return sent;
+}
+
+/*
+ * Appends length bytes of data to the session's backlog.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+static int
+sessionkeep( Session * session, const char * data, int length )
+{
+	char		* backlog;
+	int		size;
+
+	if ( session->backloglen + length > session->backlogsize )
+	{
+		for ( size = session->backlogsize > 0 ? session->backlogsize : SESSION_OUTBUF; size < session->backloglen + length; size *= 2 );
+		if ( (backlog = (char *) realloc(session->backlog, size)) == NULL )
+		{
+			errormessage("realloc() failed");
+			return -1;
+		}
+		session->backlog = backlog;
+		session->backlogsize = size;
+	}
+	memcpy(session->backlog + session->backloglen, data, length);
+	session->backloglen += length;
+	return 0;
+}
+
+/*
+ * Sends the buffered reply to the client, once the log records of the
+ * operations it reports are on disk.  Blocking sessions wait for their
+ * socket.  Event loop sessions keep what their non-blocking socket does
+ * not take in the backlog; it goes out first, on a later flush once the
+ * event loop sees the socket writable.
+ *
+ * Returns 0 on success, -1 if the client is gone or the log failed.  The
+ * reply is dropped then.
+ */
+int
+sessionflush( Session * session )
+{
+	int		sent, rv;
+
+	if ( session->outlen > 0 && walcommit() != 0 )
+	{
+		session->outlen = 0;
+		return -1;
+	}
+	else if ( session->backloglen > 0 )
+	{
+		/* Older replies first */
+		rv = sessionkeep( session, session->outbuf, session->outlen );
+		session->outlen = 0;
+		if ( rv != 0 || (sent = sessionsend( session, session->backlog, session->backloglen )) == -1 )
+		{
+			return -1;
+		}
+		session->backloglen -= sent;
+		memmove(session->backlog, session->backlog + sent, session->backloglen);
+		return 0;
+	}
+	else if ( (sent = sessionsend( session, session->outbuf, session->outlen )) == -1 )
+	{
+		session->outlen = 0;
+		return -1;
+	}
+	rv = sent < session->outlen ? sessionkeep( session, session->outbuf + sent, session->outlen - sent ) : 0;
+	session->outlen = 0;
+	return rv;
+}
+
+/*
+ * Appends the command prompt to the session's reply.  Machine and binary
+ * sessions get no prompt.
+ */
+void
+sessionprompt( Session * session )
+{
+	if ( session->mode == SESSION_TEXT )
+	{
+		sessionputs( session, "Enter command: " );
+	}
+}
+
+/*
+ * Appends the reply to a machine mode or binary request: a binary frame,
+ * or in machine mode the line "<status> <id> <balance>".
+ */
+static void
+sessionstatus( Session * session, int opcode, int status, int id, int64_t amount )
+{
+	Frame		frame;
+	char		buff[FRAME_REPLY + AMOUNT_STRLEN + 32];
+	char		text[AMOUNT_STRLEN];
+	int		length;
+
+	if ( session->mode == SESSION_MACHINE )
+	{
+		length = snprintf(buff, sizeof(buff), "%s %d %s\n", framestatus( status ), id, formatamount( amount, text ));
+		sessionreply( session, buff, length );
+		return;
+	}
+	frame.opcode = opcode;
+	frame.status = status;
+	frame.id = id;
+	frame.amount = amount;
+	frameformat( &frame, buff );
+	sessionreply( session, buff, FRAME_REPLY );
+}
+
+/*
+ * Marks the account as in session for this client and tells the client.
+ */
+static void
+sessionbegin( Session * session, int id, const char * name )
+{
+	session->asflag = 1;
+	session->waitid = -1;
+	session->currid = id;
+	strncpy( session->currAccount, name, ACCOUNT_NAMEMAX );
+	session->currAccount[ACCOUNT_NAMEMAX] = '\0';
+
+	*bankflags( bank, id ) |= ACCOUNT_INSESSION;
+	dirtymark( id );
+
+	logevent( LOG_STARTED, 0, 0, NULL, 0 );
+	if ( session->mode != SESSION_TEXT )
+	{
+		sessionstatus( session, FRAME_START, FRAME_OK, id,
+			__atomic_load_n( bankbalance( bank, id ), __ATOMIC_SEQ_CST ) );
+		return;
+	}
+	sessionputs( session, "Session starting for: " );
+	sessionreply( session, name, strlen(name) );
+	sessionputs( session, "\n" );
+}
+
+/*
+ * Ends the session on the current account, if any, and hands the account
+ * to the next client queued on it.
+ *
+ * Returns 0 on success, -1 if the account could not be found.
+ */
+static int
+sessionend( Session * session )
+{
+	int	id;
+
+	if ( session->asflag != 1 )
+	{
+		return 0;
+	}
+	else if( ( id = getIDfromname( session->currAccount ) ) == -1 )
+	{
+		return -1;
+	}
+	else
+	{
+		*bankflags( bank, id ) &= ~ACCOUNT_INSESSION;
+		dirtymark( id );
+		session->asflag = 0;
+		bzero(session->currAccount, sizeof(session->currAccount));
+		sessiongate_leave( &bankaccount( bank, id )->clientsession );
+	}
+	return 0;
+}
+
+/*
+ * Sets the session's wait deadline seconds from now.
+ */
+static void
+sessiondeadline( Session * session, int seconds )
+{
+	clock_gettime( CLOCK_MONOTONIC, &session->deadline );
+	session->deadline.tv_sec += seconds;
+}
+
+/*
+ * Strips an optional wait timeout, in seconds, from the front of a start
+ * argument ("start [-t seconds] <name>") and sets the session deadline.
+ * The option goes first so that a name ending in a number still names
+ * the account.
+ *
+ * Returns 0 on success, -1 if -t is not followed by a number of seconds
+ * from 1 to SESSION_TIMEOUTMAX and a name.
+ */
+static int
+sessiontimeout( Session * session, char * argument )
+{
+	char		* cp, * seconds;
+	long		value;
+
+	session->deadline.tv_sec = session->deadline.tv_nsec = 0;
+	if ( strncmp(argument, "-t", 2) != 0 || (argument[2] != ' ' && argument[2] != '\0') )
+	{
+		return 0;
+	}
+	for ( seconds = argument + 2; *seconds == ' '; seconds++ );
+	if ( *seconds < '0' || *seconds > '9' )
+	{
+		return -1;
+	}
+	value = strtol( seconds, &cp, 10 );
+	if ( *cp != ' ' || cp[1] == '\0' || value <= 0 || value > SESSION_TIMEOUTMAX )
+	{
+		return -1;
+	}
+	sessiondeadline( session, (int) value );
+	memmove(argument, cp + 1, strlen(cp + 1) + 1);
+	return 0;
+}
+
+/*
+ * Returns 1 if the session has a wait deadline and it has passed.
+ */
+static int
+sessionexpired( Session * session )
+{
+	struct timespec		now;
+
+	if ( session->deadline.tv_sec == 0 )
+	{
+		return 0;
+	}
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return now.tv_sec > session->deadline.tv_sec
+		|| (now.tv_sec == session->deadline.tv_sec && now.tv_nsec >= session->deadline.tv_nsec);
+}
+
+/*
+ * Gives up waiting for the account the session is queued on.
+ */
+static void
+sessioncancel( Session * session )
+{
+	sessiongate_cancel( &bankaccount( bank, session->waitid )->clientsession, session->ticket );
+	session->waitid = -1;
+}
+
+/*
+ * Gives up waiting for an account because the deadline passed and tells
+ * the client.
+ */
+static void
+sessiontimedout( Session * session )
+{
+	if ( session->mode != SESSION_TEXT )
+	{
+		sessionstatus( session, FRAME_START, FRAME_TIMEDOUT, session->waitid, 0 );
+	}
+	else
+	{
+		sessionputs( session, "Timed out waiting for account\n" );
+	}
+	sessioncancel( session );
+}
+
+/*
+ * Sleeps until the queued session gets its account, its deadline passes or
+ * the client goes away.  Used by blocking sessions only.
+ *
+ * Returns SESSION_EXIT if the client closed the connection while waiting.
+ */
+static int
+sessionwait( Session * session )
+{
+	struct timespec		slice;
+	char			c;
+
+	sessionflush( session );
+	while ( 1 )
+	{
+		clock_gettime( CLOCK_MONOTONIC, &slice );
+		slice.tv_sec++;
+		if ( session->deadline.tv_sec != 0 && session->deadline.tv_sec < slice.tv_sec )
+		{
+			slice = session->deadline;
+		}
+		if ( sessiongate_wait( &bankaccount( bank, session->waitid )->clientsession, bankflags( bank, session->waitid ), session->ticket, &slice ) == 0 )
+		{
+			sessionbegin( session, session->waitid, session->waitAccount );
+			return SESSION_CONTINUE;
+		}
+		else if ( sessionexpired( session ) )
+		{
+			sessiontimedout( session );
+			return SESSION_CONTINUE;
+		}
+		else if ( recv(session->sd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0 )
+		{
+			sessioncancel( session );
+			return SESSION_EXIT;
+		}
+	}
+}
+
+/*
+ * Takes the account for the session, or queues the session on it if
+ * another client holds it.  Blocking sessions sleep in sessionwait(),
+ * event loop sessions are parked.
+ *
+ * Returns SESSION_CONTINUE, SESSION_WAIT or SESSION_EXIT.
+ */
+static int
+sessionstart( Session * session, int id, const char * name )
+{
+	int		error;
+
+	if ( (error = sessiongate_enter( &bankaccount( bank, id )->clientsession, bankflags( bank, id ), &session->ticket )) == 0 )
+	{
+		sessionbegin( session, id, name );
+	}
+	else if ( error == EAGAIN && session->mode != SESSION_TEXT )
+	{
+		sessionstatus( session, FRAME_START, FRAME_BUSY, id, 0 );
+	}
+	else if ( error == EAGAIN )
+	{
+		sessionputs( session, "Too many clients waiting for account\n" );
+	}
+	else
+	{
+		logevent( LOG_INSESSION, 0, 0, NULL, 0 );
+		if ( session->mode == SESSION_TEXT )
+		{
+			sessionputs( session, "Account currently in session\n" );
+		}
+		session->waitid = id;
+		strncpy( session->waitAccount, name, ACCOUNT_NAMEMAX );
+		session->waitAccount[ACCOUNT_NAMEMAX] = '\0';
+		if ( !session->blocking )
+		{
+			/* Park the session, the event loop will sessionretry() it */
+			return SESSION_WAIT;
+		}
+		return sessionwait( session );
+	}
+	return SESSION_CONTINUE;
+}
+
+/*
+ * Runs "batch [atomic] <+amount|-amount> ..." on the account in session.
+ * The credits (+) and debits (-) are applied in order with one update of
+ * the balance, and with atomic either all of them or none.  results gets
+ * one character per operation: '.' applied, 'F' insufficient funds, 'O'
+ * balance overflow, 'I' invalid amount, '-' not applied because the
+ * atomic batch failed.
+ *
+ * Returns FRAME_OK, FRAME_FUNDS, FRAME_OVERFLOW or FRAME_INVALID if an
+ * atomic batch was not applied, FRAME_INVALID for an empty or too long
+ * batch.
+ */
+static int
+sessionbatch( Session * session, char * argument, char * results, int64_t * balance )
+{
+	int64_t		amounts[SESSION_BATCHMAX];
+	int		applied[SESSION_BATCHMAX];
+	int		position[SESSION_BATCHMAX];
+	char		* token, * cp;
+	int		atomic, n, ops, i, status;
+
+	atomic = n = ops = 0;
+	results[0] = '\0';
+	for ( cp = argument; *cp != '\0'; )
+	{
+		for ( ; *cp == ' '; cp++ );
+		for ( token = cp; *cp != '\0' && *cp != ' '; cp++ );
+		if ( cp == token )
+		{
+			break;
+		}
+		else if ( *cp != '\0' )
+		{
+			*cp++ = '\0';
+		}
+		if ( ops == 0 && !atomic && strcmp(token, "atomic") == 0 )
+		{
+			atomic = 1;
+			continue;
+		}
+		else if ( ops == SESSION_BATCHMAX )
+		{
+			results[0] = '\0';
+			return FRAME_INVALID;
+		}
+		else if ( (token[0] != '+' && token[0] != '-') || parseamount( token + 1, &amounts[n] ) != 0 )
+		{
+			results[ops++] = 'I';
+			continue;
+		}
+		amounts[n] = token[0] == '-' ? -amounts[n] : amounts[n];
+		position[n++] = ops++;
+	}
+	results[ops] = '\0';
+	*balance = __atomic_load_n( bankbalance( bank, session->currid ), __ATOMIC_SEQ_CST );
+	if ( ops == 0 )
+	{
+		return FRAME_INVALID;
+	}
+	else if ( atomic && n != ops )
+	{
+		status = FRAME_INVALID;
+	}
+	else if ( bankbatch( bank, session->currid, amounts, n, atomic, applied, balance ) != n && atomic )
+	{
+		for ( status = FRAME_FUNDS, i = 0; i < n; i++ )
+		{
+			status = applied[i] == -3 ? FRAME_OVERFLOW : status;
+		}
+	}
+	else
+	{
+		status = FRAME_OK;
+	}
+	for ( i = 0; i < n; i++ )
+	{
+		if ( status == FRAME_OK || ((status == FRAME_FUNDS || status == FRAME_OVERFLOW) && applied[i] != 0) )
+		{
+			results[position[i]] = applied[i] == 0 ? '.' : applied[i] == -2 ? 'F' : 'O';
+		}
+		else
+		{
+			results[position[i]] = '-';
+		}
+	}
+	logevent( LOG_BATCH, ops, 0, results, strlen(results) );
+	return status;
+}
+
+/*
+ * Runs a machine mode command line as the equivalent binary request, so
+ * it gets the same one line status reply.  Batches reply with the line
+ * followed by their results.  stats has no binary request, it replies with
+ * the line, the tables of the text command and an empty line.
+ *
+ * Returns SESSION_CONTINUE, SESSION_WAIT or SESSION_EXIT.
+ */
+static int
+sessionmachine( Session * session, int command, char * argument )
+{
+	Frame		frame;
+	char		results[SESSION_BATCHMAX + 1];
+	char		buff[SESSION_BATCHMAX + AMOUNT_STRLEN + 32];
+	char		text[AMOUNT_STRLEN];
+	char		report[STATS_REPORTMAX];
+	char		locks[LOCKPROF_REPORTMAX];
+	int64_t		balance;
+	int		status;
+
+	if ( command == COMMAND_STATS )
+	{
+		sessionstatus( session, 0, FRAME_OK, -1, 0 );
+		sessionreply( session, report, statsreport( report, sizeof(report) ) );
+		sessionreply( session, locks, lockprof_report( locks, sizeof(locks) ) );
+		sessionputs( session, "\n" );
+		return SESSION_CONTINUE;
+	}
+	else if ( command == COMMAND_BATCH )
+	{
+		results[0] = '\0';
+		balance = 0;
+		status = session->asflag == 1 ? sessionbatch( session, argument, results, &balance ) : FRAME_NOSESSION;
+		sessionreply( session, buff, snprintf(buff, sizeof(buff), "%s %d %s%s%s\n", framestatus( status ),
+			session->asflag == 1 ? session->currid : -1, formatamount( balance, text ), results[0] ? " " : "", results) );
+		return SESSION_CONTINUE;
+	}
+	frame.opcode = command + 1;
+	frame.id = -1;
+	frame.amount = 0;
+	if ( command == COMMAND_START && sessiontimeout( session, argument ) != 0 )
+	{
+		sessionstatus( session, FRAME_START, FRAME_ERROR, -1, 0 );
+		return SESSION_CONTINUE;
+	}
+	else if ( (command == COMMAND_CREDIT || command == COMMAND_DEBIT) && parseamount( argument, &frame.amount ) != 0 )
+	{
+		frame.amount = -1;
+	}
+	else if ( (command == COMMAND_OPEN || command == COMMAND_START) && strlen(argument) > FRAME_NAMEMAX )
+	{
+		/* Never cut a name, the prefix may be another account */
+		sessionstatus( session, frame.opcode, FRAME_INVALID, -1, 0 );
+		return SESSION_CONTINUE;
+	}
+	strncpy( frame.name, argument, FRAME_NAMEMAX );
+	frame.name[FRAME_NAMEMAX] = '\0';
+	return sessionframe( session, &frame );
+}
+
+/*
+ * Executes one parsed text mode command for the session and writes the
+ * reply.
+ *
+ * Returns SESSION_CONTINUE, SESSION_WAIT if the session is parked waiting
+ * for an account, or SESSION_EXIT if the client asked to exit.
+ */
+static int
+sessiontext( Session * session, int rv, char * arg )
+{
+	int			id, error;
+	int64_t			amount, balance;
+	char			argument[256];
+	char			balancefloat[AMOUNT_STRLEN];
+	char			results[SESSION_BATCHMAX + 1];
+	char			report[STATS_REPORTMAX];
+	char			locks[LOCKPROF_REPORTMAX];
+
+	bzero( argument, sizeof(argument));
+	strncpy( argument, arg, sizeof(argument) - 1 );
+	switch (rv)
+	{
+		case COMMAND_OPEN: // open account - requires argument
+			if( session->asflag != 1 )
+			{
+				if ( strlen(argument) > ACCOUNT_NAMEMAX )
+				{
+					sessionputs( session, "Account name is too long.\n" );
+				}
+				else if( ( id = openaccount( argument ) ) == -1 )
+				{
+					sessionputs( session, "Could not create account: Bank is full.\n" );
+				}
+				else if( id == -2)
+				{
+					sessionputs( session, "An account with that name already exists.\n" );
+				}
+				else if( id == -3)
+				{
+					sessionputs( session, "Could not create account" );
+				}
+				else
+				{
+					sessionputs( session, "Account successfully opened for: " );
+					sessionreply( session, argument, strlen(argument) );
+					sessionputs( session, "\n" );
+				}
+			}
+			else
+			{
+				logevent( LOG_INSESSION, 0, 0, NULL, 0 );
+				sessionputs( session, "Account currently in session\n" );
+				sessionputs( session, "\n" );
+			}
+			break;
+		case COMMAND_START: // start account - requires argument, optional "-t seconds" wait timeout before it.
+			if( session->asflag != 1 )
+			{
+				if ( sessiontimeout( session, argument ) != 0 )
+				{
+					sessionputs( session, "Usage: start [-t seconds] <name>\n" );
+				}
+				else if ( strlen(argument) > ACCOUNT_NAMEMAX )
+				{
+					sessionputs( session, "Account name is too long.\n" );
+				}
+				else if( ( id = getIDfromname( argument ) ) == -1)
+				{
+					sessionputs( session, "Account does not exist.\n" );
+				}
+				else if ( (rv = sessionstart( session, id, argument )) != SESSION_CONTINUE )
+				{
+					return rv;
+				}
+			}
+			else
+			{
+				logevent( LOG_INSESSION, 0, 0, NULL, 0 );
+				sessionputs( session, "Account currently in session\n" );
+				sessionputs( session, "\n" );
+			}
+			break;
+		case COMMAND_CREDIT: // credit account - requires argument and account started flag.
+			if( session->asflag != 1 )
+			{
+				logevent( LOG_NOSESSION, 0, 0, NULL, 0 );
+				sessionputs( session, "Account must be in session first\n" );
+				sessionputs( session, "\n" );
+			}
+			else
+			{
+				if( parseamount( argument, &amount ) != 0 )
+				{
+					sessionputs( session, "Invalid amount\n" );
+				}
+				else if( (id = creditaccount( amount, session->currAccount ) ) == -1 )
+				{
+					sessionputs( session, "Crediting went wrong\n" );
+				}
+				else if(id == -3)
+				{
+					sessionputs( session, "Credit would overflow the balance.\n" );
+					sessionputs( session, "\n" );
+				}
+				else
+				{
+					logevent( LOG_CREDITING, 0, 0, NULL, 0 );
+					sessionputs( session, "Crediting account: $" );
+					sessionreply( session, argument, strlen(argument) );
+					sessionputs( session, "\n" );
+				}
+			}
+			break;
+		case COMMAND_DEBIT: // debit account - requires argument and account started flag.
+			if( session->asflag != 1 )
+			{
+				logevent( LOG_NOSESSION, 0, 0, NULL, 0 );
+				sessionputs( session, "Account must be in session first\n" );
+				sessionputs( session, "\n" );
+			}
+			else
+			{
+				if( parseamount( argument, &amount ) != 0 )
+				{
+					sessionputs( session, "Invalid amount\n" );
+				}
+				else if( (id = debitaccount( amount, session->currAccount ) ) == -1 )
+				{
+					sessionputs( session, "Debiting went wrong\n" );
+					sessionputs( session, "\n" );
+				}
+				else if(id == -2)
+				{
+					sessionputs( session, "Insufficient funds.\n" );
+					sessionputs( session, "\n" );
+				}
+				else
+				{
+					logevent( LOG_DEBITING, 0, 0, NULL, 0 );
+					sessionputs( session, "Debiting account: $" );
+					sessionreply( session, argument, strlen(argument) );
+					sessionputs( session, "\n" );
+				}
+			}
+			break;
+		case COMMAND_BALANCE: // account balance - requires account started flag.
+			if( session->asflag != 1 )
+			{
+				logevent( LOG_NOSESSION, 0, 0, NULL, 0 );
+				sessionputs( session, "Account must be in session first\n" );
+				sessionputs( session, "\n" );
+			}
+			else
+			{
+				if( (balance = accountbalance( session->currAccount ) ) == -1)
+				{
+					sessionputs( session, "Checking account balance went wrong\n" );
+				}
+				else
+				{
+					logevent( LOG_PRINTING, 0, 0, NULL, 0 );
+					sessionputs( session, "Printing account balance: $" );
+					formatamount( balance, balancefloat );
+					sessionreply( session, balancefloat, strlen(balancefloat) );
+					sessionputs( session, "\n" );
+				}
+			}
+			break;
+		case COMMAND_BATCH: // batch - requires account started flag, argument is the whole line.
+			if( session->asflag != 1 )
+			{
+				logevent( LOG_NOSESSION, 0, 0, NULL, 0 );
+				sessionputs( session, "Account must be in session first\n" );
+				sessionputs( session, "\n" );
+			}
+			else
+			{
+				if ( (error = sessionbatch( session, arg, results, &balance )) == FRAME_INVALID && results[0] == '\0' )
+				{
+					sessionputs( session, "Invalid batch\n" );
+					break;
+				}
+				if ( error == FRAME_OK )
+				{
+					sessionputs( session, "Batch results: " );
+				}
+				else
+				{
+					sessionputs( session, "Batch not applied: " );
+				}
+				sessionreply( session, results, strlen(results) );
+				sessionputs( session, "\nPrinting account balance: $" );
+				formatamount( balance, balancefloat );
+				sessionreply( session, balancefloat, strlen(balancefloat) );
+				sessionputs( session, "\n" );
+			}
+			break;
+		case COMMAND_FINISH: // finish - requires acount started flags, resets flag.
+			if( session->asflag != 1 )
+			{
+				logevent( LOG_NOSESSION, 0, 0, NULL, 0 );
+				sessionputs( session, "Account must be in session first\n" );
+				sessionputs( session, "\n" );
+			}
+			else if( sessionend( session ) == -1 )
+			{
+				sessionputs( session, "Something went wrong with finish\n" );
+				sessionputs( session, "\n" );
+			}
+			else
+			{
+				logevent( LOG_ENDING, 0, 0, NULL, 0 );
+				sessionputs( session, "Ending session now\n" );
+				sessionputs( session, "\n" );
+			}
+			break;
+		case COMMAND_BINARY: // binary - switches the connection to binary frames, no prompt.
+			session->mode = SESSION_BINARY;
+			sessionputs( session, "Binary mode\n" );
+			return SESSION_CONTINUE;
+		case COMMAND_MACHINE: // machine - one status line per command from now on, no prompt.
+			session->mode = SESSION_MACHINE;
+			sessionstatus( session, 0, FRAME_OK, -1, 0 );
+			return SESSION_CONTINUE;
+		case COMMAND_STATS: // stats - latencies of every command so far, and lock profiles with -p, can be called whenever.
+			sessionreply( session, report, statsreport( report, sizeof(report) ) );
+			sessionreply( session, locks, lockprof_report( locks, sizeof(locks) ) );
+			break;
+		case COMMAND_EXIT: // exit - can be called whenever, ends any session in progress.
+			if( session->asflag == 1 )
+			{
+				//Calling exit while inside a session
+				sessionend( session );
+				logevent( LOG_ENDING, 0, 0, NULL, 0 );
+				sessionputs( session, "Ending session now\n" );
+			}
+			sessionputs( session, "Exiting. Thank you for using the bank of JuJu\n" );
+			return SESSION_EXIT;
+		default: // error, report back to client
+			sessionputs( session, "There was an error processing your request\n" );
+			sessionputs( session, "\n" );
+			break;
+	}
+	sessionprompt( session );
+	return SESSION_CONTINUE;
+}
+
+/*
+ * Executes one command line for the session and writes the reply.  Its
+ * latency is added to the statistics of the command.
+ *
+ * Returns SESSION_CONTINUE, SESSION_WAIT if the session is parked waiting
+ * for an account, or SESSION_EXIT if the client asked to exit.
+ */
+int
+sessioncommand( Session * session, char * line, int length )
+{
+	uint64_t		started;
+	char			* arg;
+	int			command, rv;
+
+	started = statsnow();
+	logevent( LOG_CLIENT, 0, 0, line, length );
+	command = parsecommand( line, length, &arg );
+	if ( session->mode == SESSION_MACHINE && command != COMMAND_BINARY && command != COMMAND_MACHINE )
+	{
+		rv = sessionmachine( session, command, arg );
+	}
+	else
+	{
+		rv = sessiontext( session, command, arg );
+	}
+	statsrecord( command, started );
+	return rv;
+}
+
+/*
+ * Returns the account a binary request names, by id if it has one and by
+ * name otherwise, -1 if there is no such account.
+ */
+static int
+sessionaccount( Frame * frame )
+{
+	if ( frame->id < 0 )
+	{
+		return getIDfromname( frame->name );
+	}
+	else if ( frame->id >= __atomic_load_n( &bank->numaccounts, __ATOMIC_ACQUIRE ) )
+	{
+		return -1;
+	}
+	return frame->id;
+}
+
+/*
+ * Executes one binary request for the session and writes the reply frame.
+ *
+ * Returns SESSION_CONTINUE, SESSION_WAIT if the session is parked waiting
+ * for an account, or SESSION_EXIT if the client asked to exit.
+ */
+int
+sessionframe( Session * session, Frame * frame )
+{
+	int			id, status, rv;
+	int64_t			balance;
+
+	status = FRAME_OK;
+	id = session->asflag == 1 ? session->currid : -1;
+	balance = 0;
+	switch ( frame->opcode )
+	{
+		case FRAME_OPEN:
+			if ( session->asflag == 1 )
+			{
+				status = FRAME_INSESSION;
+			}
+			else if ( frame->name[0] == '\0' )
+			{
+				status = FRAME_INVALID;
+			}
+			else if ( (rv = openaccount( frame->name )) == -1 )
+			{
+				status = FRAME_FULL;
+			}
+			else if ( rv == -3 )
+			{
+				status = FRAME_ERROR;
+			}
+			else
+			{
+				status = rv == -2 ? FRAME_EXISTS : FRAME_OK;
+				id = getIDfromname( frame->name );
+			}
+			break;
+		case FRAME_START:
+			if ( session->asflag == 1 )
+			{
+				status = FRAME_INSESSION;
+			}
+			else if ( frame->amount < 0 || frame->amount > SESSION_TIMEOUTMAX )
+			{
+				status = FRAME_INVALID;
+			}
+			else if ( (id = sessionaccount( frame )) == -1 )
+			{
+				status = FRAME_NOTFOUND;
+			}
+			else
+			{
+				/* Machine mode lines set their timeout in sessionmachine() */
+				if ( session->mode == SESSION_BINARY )
+				{
+					session->deadline.tv_sec = session->deadline.tv_nsec = 0;
+				}
+				if ( frame->amount > 0 )
+				{
+					sessiondeadline( session, frame->amount );
+				}
+				/* sessionstart() replies once the session has the account */
+				return sessionstart( session, id, bankname( bank, id ) );
+			}
+			break;
+		case FRAME_CREDIT:
+			if ( session->asflag != 1 )
+			{
+				status = FRAME_NOSESSION;
+			}
+			else if ( frame->amount < 0 || frame->amount > AMOUNT_MAX )
+			{
+				status = FRAME_INVALID;
+			}
+			else if ( bankcredit( bank, id, frame->amount, &balance ) != 0 )
+			{
+				status = FRAME_OVERFLOW;
+			}
+			break;
+		case FRAME_DEBIT:
+			if ( session->asflag != 1 )
+			{
+				status = FRAME_NOSESSION;
+			}
+			else if ( frame->amount < 0 || frame->amount > AMOUNT_MAX )
+			{
+				status = FRAME_INVALID;
+			}
+			else if ( bankdebit( bank, id, frame->amount, &balance ) != 0 )
+			{
+				status = FRAME_FUNDS;
+			}
+			break;
+		case FRAME_BALANCE:
+			if ( session->asflag != 1 )
+			{
+				status = FRAME_NOSESSION;
+			}
+			else
+			{
+				balance = __atomic_load_n( bankbalance( bank, id ), __ATOMIC_SEQ_CST );
+			}
+			break;
+		case FRAME_FINISH:
+			if ( session->asflag != 1 )
+			{
+				status = FRAME_NOSESSION;
+			}
+			else if ( sessionend( session ) == -1 )
+			{
+				status = FRAME_ERROR;
+			}
+			break;
+		case FRAME_EXIT:
+			sessionend( session );
+			sessionstatus( session, frame->opcode, status, id, balance );
+			return SESSION_EXIT;
+		default:
+			status = FRAME_ERROR;
+			break;
+	}
+	sessionstatus( session, frame->opcode, status, id, balance );
+	return SESSION_CONTINUE;
+}
+
+/*
+ * Drops the NUL padding bankclient sends after every command from a line.
+ *
+ * Returns the new length of the line.
+ */
+static int
+sessionstrip( char * line, int length )
+{
+	char		* cp, * end, * out;
+
+	if ( (out = memchr(line, '\0', length)) == NULL )
+	{
+		return length;
+	}
+	for ( cp = out, end = line + length; cp < end; cp++ )
+	{
+		if ( *cp != '\0' )
+		{
+			*out++ = *cp;
+		}
+	}
+	return out - line;
+}
+
+/*
+ * Runs every complete command buffered for the session: newline terminated
+ * lines in text mode, whole frames in binary mode.  Commands are executed
+ * where they sit in the buffer, which is compacted once afterwards.  A
+ * full buffer without a newline is run as one command.  The replies to all
+ * of them go out in one send(), right away for blocking sessions and from
+ * the event loop otherwise.
+ *
+ * Returns SESSION_CONTINUE, SESSION_WAIT or SESSION_EXIT.
+ */
+int
+sessiondrain( Session * session )
+{
+	Frame		frame;
+	uint64_t	started;
+	char		* line, * newline;
+	int		start, length, rv;
+
+	rv = SESSION_CONTINUE;
+	for ( start = 0; session->waitid == -1 && start < session->inlen; start += length )
+	{
+		line = session->inbuf + start;
+		if ( session->mode == SESSION_BINARY )
+		{
+			if ( (length = frameparse( line, session->inlen - start, &frame )) == 0 )
+			{
+				break;
+			}
+			else if ( length == -1 )
+			{
+				/* Cannot find the next frame, give up on the client */
+				sessionstatus( session, 0, FRAME_ERROR, -1, 0 );
+				rv = SESSION_EXIT;
+			}
+			else
+			{
+				started = statsnow();
+				rv = sessionframe( session, &frame );
+				/* Frame opcodes are the COMMAND_ codes plus one */
+				statsrecord( frame.opcode - 1, started );
+			}
+		}
+		else
+		{
+			if ( (newline = memchr(line, '\n', session->inlen - start)) != NULL )
+			{
+				length = newline - line + 1;
+			}
+			else if ( start == 0 && session->inlen == SESSION_INBUF )
+			{
+				length = session->inlen;
+			}
+			else
+			{
+				break;
+			}
+			rv = sessioncommand( session, line, sessionstrip( line, length ) );
+		}
+		if ( rv == SESSION_EXIT )
+		{
+			sessionflush( session );
+			return rv;
+		}
+	}
+	if ( start > 0 )
+	{
+		session->inlen -= start;
+		memmove(session->inbuf, session->inbuf + start, session->inlen);
+	}
+	if ( !session->blocking )
+	{
+		/* The event loop flushes all its sessions after one commit */
+		return rv;
+	}
+	return sessionflush( session ) == 0 ? rv : SESSION_EXIT;
+}
+
+/*
+ * Reads whatever is available on the session socket and runs every
+ * complete command received so far.
+ *
+ * Returns SESSION_WAIT if the session parked in start, SESSION_EXIT on end
+ * of file, error or exit.
+ */
+int
+sessioninput( Session * session )
+{
+	int		n;
+
+	if ( session->inlen == SESSION_INBUF )
+	{
+		/* Still parked on a full buffer, leave the rest in the socket */
+		return sessiondrain( session );
+	}
+	n = read(session->sd, session->inbuf + session->inlen, SESSION_INBUF - session->inlen);
+	if ( n == 0 )
+	{
+		return SESSION_EXIT;
+	}
+	else if ( n == -1 )
+	{
+		return (errno == EAGAIN || errno == EINTR) ? SESSION_CONTINUE : SESSION_EXIT;
+	}
+	session->inlen += n;
+	return sessiondrain( session );
+}
+
+/*
+ * Checks whether a parked start got its account or timed out.
+ *
+ * Returns SESSION_WAIT while the session is still queued.
+ */
+int
+sessionretry( Session * session )
+{
+	if ( session->waitid == -1 )
+	{
+		return SESSION_CONTINUE;
+	}
+	else if ( sessiongate_poll( &bankaccount( bank, session->waitid )->clientsession, bankflags( bank, session->waitid ), session->ticket ) == 0 )
+	{
+		sessionbegin( session, session->waitid, session->waitAccount );
+	}
+	else if ( sessionexpired( session ) )
+	{
+		sessiontimedout( session );
+	}
+	else
+	{
+		return SESSION_WAIT;
+	}
+	sessionprompt( session );
+	return SESSION_CONTINUE;
+}
+
+/*
+ * Releases any account held or waited for by the session and closes its
+ * socket.
+ */
+void
+sessionclose( Session * session )
+{
+	if ( session->waitid != -1 )
+	{
+		sessioncancel( session );
+	}
+	sessionend( session );
+	close( session->sd );
+	free( session->backlog );
+	session->backlog = NULL;
+	session->backloglen = session->backlogsize = 0;
+}
@@ -0,0 +1,184 @@
+#ifndef BANKSESSION_H
+#define BANKSESSION_H
+/*
+ * banksession.h
+ */
+#include <string.h>
+#include <sys/socket.h>
+
+/*
+ * Size of the per-connection input buffer.  A command line longer than
+ * this is cut and run as one command.
+ */
+#define SESSION_INBUF		4096
+
+/*
+ * Size of the per-connection output buffer.  Replies are assembled here
+ * and sent once per batch of commands.
+ */
+#define SESSION_OUTBUF		4096
+
+/*
+ * Unsent output an event loop session may pile up before the loop stops
+ * reading its commands, see sessionflush().
+ */
+#define SESSION_BACKLOGMAX	65536
+
+/*
+ * Most operations in one batch command.
+ */
+#define SESSION_BATCHMAX	1024
+
+/*
+ * Longest wait, in seconds, a start timeout may ask for.
+ */
+#define SESSION_TIMEOUTMAX	86400
+
+/*
+ * Return values of sessioncommand() and sessionretry().
+ */
+#define SESSION_CONTINUE	0
+#define SESSION_WAIT		1
+#define SESSION_EXIT		-1
+
+/*
+ * Session modes: the interactive text protocol, machine mode (text
+ * commands, one "<status> <id> <balance>" line per reply, no prompts) and
+ * the bankframe.h binary frames.
+ */
+#define SESSION_TEXT		0
+#define SESSION_MACHINE		1
+#define SESSION_BINARY		2
+
+/*
+ * A struct representing one client connection.
+ *
+ * blocking sessions (one per fork()ed process) sleep on the account's
+ * SessionGate while waiting for it; event loop sessions park in
+ * SESSION_WAIT instead, holding ticket, and are retried with sessionretry()
+ * when a gate wakes their loop.
+ * A deadline.tv_sec of 0 means wait forever.  mode is one of the
+ * SESSION_ modes below.
+ *
+ * backlog holds the backloglen bytes of replies an event loop session's
+ * socket did not take yet, in a malloc()ed buffer of backlogsize bytes.
+ * events are the epoll events the event loop is watching for.
+ */
+struct Session_ {
+	int			sd;
+	int			blocking;
+	int			asflag;
+	int			mode;
+	char			currAccount[ACCOUNT_NAMEMAX + 1];
+	int			currid;
+	int			waitid;
+	char			waitAccount[ACCOUNT_NAMEMAX + 1];
+	unsigned int		ticket;
+	struct timespec		deadline;
+	char			inbuf[SESSION_INBUF + 1];
+	int			inlen;
+	char			outbuf[SESSION_OUTBUF];
+	int			outlen;
+	char			* backlog;
+	int			backloglen;
+	int			backlogsize;
+	uint32_t		events;
+	struct Session_		* next;
+	struct Session_		* prev;
+};
+
+typedef struct Session_ Session;
+
+/*
+ * Mode new sessions start in, SESSION_TEXT unless the server was started
+ * with -m.
+ */
+extern int sessiondefaultmode;
+
+/*
+ * Initializes a session for the given socket descriptor.
+ */
+void
+sessioninit( Session * session, int sd, int blocking );
+
+/*
+ * Appends length bytes to the session's reply, flushing first if they do
+ * not fit.
+ */
+void
+sessionreply( Session * session, const char * data, int length );
+
+/*
+ * Appends a string literal, without its NUL, to the session's reply.
+ */
+#define sessionputs(session, s)	sessionreply( session, s, sizeof(s) - 1 )
+
+/*
+ * Sends the buffered reply to the client.  Event loop sessions never wait
+ * for their socket; what it does not take is kept in the backlog, which
+ * later flushes send first.
+ *
+ * Returns 0 on success, -1 if the client is gone.
+ */
+int
+sessionflush( Session * session );
+
+/*
+ * Appends the command prompt to the session's reply.
+ */
+void
+sessionprompt( Session * session );
+
+/*
+ * Reads whatever is available on the session socket and runs every
+ * complete command received so far.
+ *
+ * Returns SESSION_WAIT if the session parked in start, SESSION_EXIT on end
+ * of file, error or exit.
+ */
+int
+sessioninput( Session * session );
+
+/*
+ * Runs every complete command (text line or binary frame) buffered for the
+ * session, stopping early if the session parks in start.
+ *
+ * Returns SESSION_CONTINUE, SESSION_WAIT or SESSION_EXIT.
+ */
+int
+sessiondrain( Session * session );
+
+/*
+ * Executes one command line for the session and writes the reply.  The
+ * line is parsed in place and line[length] must be writable.
+ *
+ * Returns SESSION_CONTINUE, SESSION_WAIT if the session is parked waiting
+ * for an account, or SESSION_EXIT if the client asked to exit.
+ */
+int
+sessioncommand( Session * session, char * line, int length );
+
+/*
+ * Executes one binary request for the session and writes the reply frame.
+ *
+ * Returns SESSION_CONTINUE, SESSION_WAIT if the session is parked waiting
+ * for an account, or SESSION_EXIT if the client asked to exit.
+ */
+int
+sessionframe( Session * session, Frame * frame );
+
+/*
+ * Checks whether a parked start got its account or timed out.
+ *
+ * Returns SESSION_WAIT while the session is still queued.
+ */
+int
+sessionretry( Session * session );
+
+/*
+ * Releases any account held or waited for by the session and closes its
+ * socket.
+ */
+void
+sessionclose( Session * session );
+#endif
@@ -0,0 +1,380 @@
+/*
+ * banksnapshot.c
+ * Authors:	Emmanuel Baah
+ * 		Yuk Yan
+ *
+ * Point-in-time snapshots of the bank, taken without stopping sessions.
+ *
+ * The bank lives in MAP_SHARED memory, so a fork()ed copy would keep
+ * seeing every change; instead snapshots are epoch based.  Starting a
+ * snapshot makes bank->snapepoch odd.  From then on the first change to
+ * an account saves the balance it had into banksaved() and tags it with
+ * the epoch in bankversion(), and the snapshot takes the saved balance of
+ * tagged accounts and the live balance of the others.  Only opens are held
+ * off, while the header and the name index are copied.  The periodic
+ * report reads the balances the same way, see bankcapture().
+ *
+ * Every change of a balance goes through bankcredit(), bankdebit() or
+ * bankbatch() so that it is saved for a running snapshot, marked for the
+ * flusher and the report and logged.
+ * Changes are made by the session holding the account, so at most one
+ * change per account is in flight.
+ */
+#include "banksnapshot.h"
+
+/*
+ * Serializes the epochs of snapshots and reports, which both run in the
+ * server process.
+ */
+static pthread_mutex_t		snapshotmutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Saves the balance of an account before its first change during a
+ * running snapshot.
+ */
+static void
+bankpreserve( Bank * bank, int id )
+{
+	unsigned int	epoch;
+
+	epoch = __atomic_load_n( &bank->snapepoch, __ATOMIC_SEQ_CST );
+	if ( (epoch & 1) && __atomic_load_n( bankversion( bank, id ), __ATOMIC_RELAXED ) != epoch )
+	{
+		*banksaved( bank, id ) = __atomic_load_n( bankbalance( bank, id ), __ATOMIC_RELAXED );
+		__atomic_store_n( bankversion( bank, id ), epoch, __ATOMIC_SEQ_CST );
+	}
+}
+
+/*
+ * Credits an account held in session.
+ *
+ * Returns 0 on success, -3 if the balance would overflow.
+ */
+int
+bankcredit( Bank * bank, int id, int64_t amount, int64_t * balance )
+{
+	bankpreserve( bank, id );
+	if ( accountcredit( bankbalance( bank, id ), amount, balance ) != 0 )
+	{
+		return -3;
+	}
+	flushmark( bankbalance( bank, id ), sizeof(int64_t) );
+	dirtymark( id );
+	walappend( WAL_BALANCE, id, *balance, NULL );
+	return 0;
+}
+
+/*
+ * Debits an account held in session.
+ *
+ * Returns 0 on success, -2 for insufficient funds.
+ */
+int
+bankdebit( Bank * bank, int id, int64_t amount, int64_t * balance )
+{
+	bankpreserve( bank, id );
+	if ( accountdebit( bankbalance( bank, id ), amount, balance ) != 0 )
+	{
+		return -2;
+	}
+	flushmark( bankbalance( bank, id ), sizeof(int64_t) );
+	dirtymark( id );
+	walappend( WAL_BALANCE, id, *balance, NULL );
+	return 0;
+}
+
+/*
+ * Applies a batch to an account held in session.
+ *
+ * Returns the number of amounts applied.
+ */
+int
+bankbatch( Bank * bank, int id, const int64_t * amounts, int n, int atomic, int * results, int64_t * balance )
+{
+	int	applied;
+
+	bankpreserve( bank, id );
+	if ( (applied = accountbatch( bankbalance( bank, id ), amounts, n, atomic, results, balance )) > 0 )
+	{
+		flushmark( bankbalance( bank, id ), sizeof(int64_t) );
+		dirtymark( id );
+		walappend( WAL_BALANCE, id, *balance, NULL );
+	}
+	return applied;
+}
+
+/*
+ * Writes length bytes to fd.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+snapshotwrite( int fd, const void * data, size_t length )
+{
+	ssize_t		n;
+
+	for ( ; length > 0; data = (const char *) data + n, length -= n )
+	{
+		if ( (n = write(fd, data, length)) == -1 )
+		{
+			if ( errno == EINTR )
+			{
+				n = 0;
+				continue;
+			}
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Starts an epoch: from now on the first change to each account saves
+ * the balance it had.  Must be called with snapshotmutex held.
+ *
+ * Returns the epoch.
+ */
+static unsigned int
+snapshotbegin( Bank * bank )
+{
+	unsigned int	epoch;
+
+	epoch = bank->snapepoch + 1;
+	__atomic_store_n( &bank->snapepoch, epoch, __ATOMIC_SEQ_CST );
+	return epoch;
+}
+
+/*
+ * Returns the balance an account had when epoch started.
+ */
+static int64_t
+snapshotbalance( Bank * bank, int id, unsigned int epoch )
+{
+	int64_t		balance;
+
+	balance = __atomic_load_n( bankbalance( bank, id ), __ATOMIC_SEQ_CST );
+	if ( __atomic_load_n( bankversion( bank, id ), __ATOMIC_SEQ_CST ) == epoch )
+	{
+		/* Changed since the epoch started, take the saved balance */
+		balance = *banksaved( bank, id );
+	}
+	return balance;
+}
+
+/*
+ * Ends epoch, changes stop saving balances.
+ */
+static void
+snapshotend( Bank * bank, unsigned int epoch )
+{
+	__atomic_store_n( &bank->snapepoch, epoch + 1, __ATOMIC_SEQ_CST );
+}
+
+/*
+ * Returns the number of bytes of the bank copied as is into a snapshot:
+ * the header, the checksums, the index and the names in use.
+ */
+static size_t
+snapshotprefix( Bank * bank )
+{
+	return bank->arenaoffset + bank->arenaused;
+}
+
+/*
+ * Returns the size of the snapshot of a bank with n accounts: the header,
+ * index and names, n balances and n accounts.
+ */
+static size_t
+snapshotbytes( Bank * bank, int n )
+{
+	return snapshotprefix( bank ) + (size_t) n * (sizeof(int64_t) + sizeof(Account));
+}
+
+/*
+ * Writes a point-in-time consistent snapshot of the bank to path.  The
+ * snapshot is written to a temporary file, synced and renamed over path.
+ * Only the balances of the state records are kept; flags and saved balances
+ * do not outlive the server.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+banksnapshot( Bank * bank, const char * path )
+{
+	SnapshotHeader		header;
+	Account			* accounts;
+	int64_t			* balances;
+	Bank			* image;
+	unsigned int		epoch;
+	char			temp[256];
+	int			fd, dirfd, i, n, rv;
+
+	/* Start the snapshot, holding off opens while the index is copied */
+	pthread_mutex_lock( &snapshotmutex );
+	banklock( &bank->bankmutex );
+	n = bank->numaccounts;
+	if ( (image = (Bank *) malloc(snapshotbytes( bank, n ))) == NULL )
+	{
+		bankunlock( &bank->bankmutex );
+		pthread_mutex_unlock( &snapshotmutex );
+		errormessage("malloc() failed");
+		return -1;
+	}
+	/* Every change logged before position is already in the live balances */
+	header.position = walposition();
+	epoch = snapshotbegin( bank );
+	memcpy(image, bank, snapshotprefix( bank ));
+	bankunlock( &bank->bankmutex );
+
+	balances = (int64_t *) ((char *) image + snapshotprefix( image ));
+	accounts = (Account *) (balances + n);
+	memcpy(accounts, bankaccount( bank, 0 ), n * sizeof(Account));
+	for ( i = 0; i < n; i++ )
+	{
+		balances[i] = snapshotbalance( bank, i, epoch );
+	}
+	snapshotend( bank, epoch );
+	pthread_mutex_unlock( &snapshotmutex );
+	image->numaccounts = n;
+	image->snapepoch = epoch + 1;
+
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.generation = bank->wal.generation;
+	header.reserved = 0;
+	header.bytes = snapshotbytes( image, n );
+	snprintf(temp, sizeof(temp), "%s.tmp", path);
+	rv = -1;
+	if ( (fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1 )
+	{
+		errormessage("open() failed");
+	}
+	else if ( snapshotwrite( fd, &header, sizeof(header) ) != 0 || snapshotwrite( fd, image, header.bytes ) != 0 )
+	{
+		errormessage("Could not write snapshot");
+	}
+	else if ( fsync(fd) != 0 )
+	{
+		errormessage("fsync() failed");
+	}
+	else if ( rename(temp, path) != 0 )
+	{
+		errormessage("rename() failed");
+	}
+	else
+	{
+		if ( (dirfd = open(".", O_RDONLY)) != -1 )
+		{
+			fsync(dirfd);
+			close(dirfd);
+		}
+		printf("Snapshot of %d accounts written to %s.\n", n, path);
+		waldiscard( header.position );
+		rv = 0;
+	}
+	if ( fd != -1 )
+	{
+		close(fd);
+	}
+	free(image);
+	return rv;
+}
+
+/*
+ * Reads the balances of the *n accounts in ids, or of every open account
+ * if ids is NULL, as of one point in time.  Opens are not held off: an
+ * account opened once the epoch has started is left out.
+ *
+ * Returns a malloc()ed array of *n balances, NULL on error.
+ */
+int64_t *
+bankcapture( Bank * bank, const int * ids, int * n )
+{
+	int64_t			* balances;
+	unsigned int		epoch;
+	int			i;
+
+	pthread_mutex_lock( &snapshotmutex );
+	epoch = snapshotbegin( bank );
+	if ( ids == NULL )
+	{
+		*n = __atomic_load_n( &bank->numaccounts, __ATOMIC_ACQUIRE );
+	}
+	if ( (balances = (int64_t *) malloc((*n + 1) * sizeof(int64_t))) == NULL )
+	{
+		errormessage("malloc() failed");
+	}
+	for ( i = 0; balances != NULL && i < *n; i++ )
+	{
+		balances[i] = snapshotbalance( bank, ids == NULL ? i : ids[i], epoch );
+	}
+	snapshotend( bank, epoch );
+	pthread_mutex_unlock( &snapshotmutex );
+	return balances;
+}
+
+/*
+ * Copies the snapshot at path back into the bank if it belongs to the
+ * bank's current generation and layout.
+ *
+ * Returns 1 and sets *position if the snapshot was restored, 0 otherwise.
+ */
+int
+bankrestore( Bank * bank, const char * path, uint64_t * position )
+{
+	SnapshotHeader		header;
+	Bank			image;
+	FILE			* snapshot;
+	int			capacity, i, ok, rv;
+
+	if ( (snapshot = fopen(path, "r")) == NULL )
+	{
+		return 0;
+	}
+	rv = 0;
+	if ( fread(&header, sizeof(header), 1, snapshot) != 1 || fread(&image, sizeof(image), 1, snapshot) != 1 )
+	{
+		errormessage("Snapshot is too short");
+	}
+	else if ( memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0
+		|| header.generation != bank->wal.generation )
+	{
+		printf("Ignoring snapshot from an earlier run.\n");
+	}
+	else if ( image.formatcrc != bank->formatcrc || image.maxaccounts != bank->maxaccounts || image.arenaused > image.arenasize
+		|| header.bytes != snapshotbytes( &image, image.numaccounts ) || image.numaccounts > bank->capacity )
+	{
+		errormessage("Snapshot does not match bankdata");
+	}
+	else if ( fseek(snapshot, sizeof(header), SEEK_SET) != 0 )
+	{
+		errormessage("fseek() failed");
+	}
+	else
+	{
+		capacity = bank->capacity;
+		/* The snapshot keeps the balances dense, whatever the record size */
+		ok = fread(bank, snapshotprefix( &image ), 1, snapshot) == 1;
+		for ( i = 0; ok && i < image.numaccounts; i++ )
+		{
+			ok = fread(bankbalance( bank, i ), sizeof(int64_t), 1, snapshot) == 1;
+		}
+		if ( !ok || fread(bankaccount( bank, 0 ), sizeof(Account), image.numaccounts, snapshot) != (size_t) image.numaccounts )
+		{
+			/* Cannot happen for a snapshot that was renamed into place */
+			errormessage("Snapshot is truncated");
+		}
+		else if ( bankrelock( bank ) != 0 )
+		{
+			errormessage("Could not initialize restored locks");
+		}
+		else
+		{
+			printf("Restored snapshot of %d accounts.\n", bank->numaccounts);
+			*position = header.position;
+			rv = 1;
+		}
+		bank->capacity = capacity;
+	}
+	fclose(snapshot);
+	return rv;
+}
@@ -0,0 +1,90 @@
+#ifndef BANKSNAPSHOT_H
+#define BANKSNAPSHOT_H
+/*
+ * banksnapshot.h
+ */
+#include <stdint.h>
+
+/*
+ * The latest snapshot of the bank, next to bankdata.
+ */
+#define SNAPSHOT_PATH		"banksnapshot"
+
+#define SNAPSHOT_MAGIC		"BANKSNAP"
+
+/*
+ * Header of a snapshot file.  The image of the bank, bytes long, follows:
+ * the Bank header, the checksums, the name index and the names in use as
+ * in memory, then the balances and the Account structs of the open accounts.  Recovery
+ * replays the log of the same generation from position on top of it.
+ */
+struct SnapshotHeader_ {
+	char			magic[8];
+	uint32_t		generation;
+	uint32_t		reserved;
+	uint64_t		position;
+	uint64_t		bytes;
+};
+typedef struct SnapshotHeader_ SnapshotHeader;
+
+struct Bank_;
+
+/*
+ * Credits an account held in session, see accountcredit(), keeping its
+ * balance for a running snapshot and logging the change.
+ *
+ * Returns 0 on success, -3 if the balance would overflow.
+ */
+int
+bankcredit( struct Bank_ * bank, int id, int64_t amount, int64_t * balance );
+
+/*
+ * Debits an account held in session, see accountdebit(), keeping its
+ * balance for a running snapshot and logging the change.
+ *
+ * Returns 0 on success, -2 for insufficient funds.
+ */
+int
+bankdebit( struct Bank_ * bank, int id, int64_t amount, int64_t * balance );
+
+/*
+ * Applies a batch to an account held in session, see accountbatch(),
+ * keeping its balance for a running snapshot and logging the change.
+ *
+ * Returns the number of amounts applied.
+ */
+int
+bankbatch( struct Bank_ * bank, int id, const int64_t * amounts, int n, int atomic, int * results, int64_t * balance );
+
+/*
+ * Writes a point-in-time consistent snapshot of the bank to path while
+ * sessions keep running, then frees the part of the log it makes
+ * redundant.  Only one snapshot may be taken at a time.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+banksnapshot( struct Bank_ * bank, const char * path );
+
+/*
+ * Reads the balances of the *n accounts in ids, or of every open account
+ * if ids is NULL, as of one point in time while sessions keep running,
+ * for the periodic report.
+ *
+ * Returns a malloc()ed array of *n balances the caller frees, NULL on
+ * error.
+ */
+int64_t *
+bankcapture( struct Bank_ * bank, const int * ids, int * n );
+
+/*
+ * Copies the snapshot at path back into the bank if it belongs to the
+ * bank's current generation and layout.  Must be called before any
+ * session runs.
+ *
+ * Returns 1 and sets *position to the log offset to replay from if the
+ * snapshot was restored, 0 if there was no usable snapshot.
+ */
+int
+bankrestore( struct Bank_ * bank, const char * path, uint64_t * position );
+#endif
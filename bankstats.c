@@ -0,0 +1,177 @@
+/*
+ * bankstats.c
+ * Authors:	Emmanuel Baah
+ * 		Yuk Yan
+ *
+ * Per command latency histograms.  Every session process adds the time
+ * each of its commands took to the histogram of that command, with atomic
+ * increments on a MAP_SHARED anonymous mapping set up before the server
+ * forks, so the histograms cover every session without a lock or a
+ * collector.
+ *
+ * Buckets are log-linear as in HdrHistogram: latencies below
+ * STATS_SUBBUCKETS nanoseconds get a bucket each, and every power of two
+ * above that is split into STATS_SUBBUCKETS equal buckets.  Percentiles
+ * are read off the buckets and reported as the top of their bucket, or
+ * the longest latency seen if that is lower.
+ */
+#include "bankstats.h"
+
+static BankStats	* stats;
+
+/*
+ * Names of the commands, by COMMAND_ code.
+ */
+static const char	* statsnames[STATS_COMMANDS] = {
+	"open", "start", "credit", "debit", "balance", "finish", "exit", "binary", "machine", "batch", "stats"
+};
+
+/*
+ * Starts collecting latencies.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+statsinit( void )
+{
+	if ( (stats = mmap(0, sizeof(BankStats), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED )
+	{
+		errormessage("mmap() failed");
+		stats = NULL;
+		return -1;
+	}
+	stats->startns = statsnow();
+	return 0;
+}
+
+/*
+ * Returns the current time in nanoseconds.
+ */
+uint64_t
+statsnow( void )
+{
+	struct timespec		now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/*
+ * Returns the bucket of a latency.
+ */
+static int
+statsbucket( uint64_t ns )
+{
+	int		bits;
+
+	if ( ns < STATS_SUBBUCKETS )
+	{
+		return ns;
+	}
+	else if ( (bits = 63 - __builtin_clzll(ns)) >= STATS_MAXBITS )
+	{
+		return STATS_BUCKETS - 1;
+	}
+	return (bits - STATS_SUBBITS + 1) * STATS_SUBBUCKETS + ((ns >> (bits - STATS_SUBBITS)) & (STATS_SUBBUCKETS - 1));
+}
+
+/*
+ * Returns the highest latency counted in a bucket.
+ */
+static uint64_t
+statsvalue( int bucket )
+{
+	int		shift;
+
+	if ( bucket < STATS_SUBBUCKETS )
+	{
+		return bucket;
+	}
+	shift = bucket / STATS_SUBBUCKETS - 1;
+	return ((uint64_t) (STATS_SUBBUCKETS + bucket % STATS_SUBBUCKETS + 1) << shift) - 1;
+}
+
+/*
+ * Adds the latency of one command that started at startns.
+ */
+void
+statsrecord( int command, uint64_t startns )
+{
+	StatsHistogram	* histogram;
+	uint64_t	ns, max;
+
+	if ( stats == NULL || command < 0 || command >= STATS_COMMANDS )
+	{
+		return;
+	}
+	ns = statsnow() - startns;
+	histogram = &stats->commands[command];
+	__atomic_add_fetch( &histogram->buckets[statsbucket( ns )], 1, __ATOMIC_RELAXED );
+	__atomic_add_fetch( &histogram->totalns, ns, __ATOMIC_RELAXED );
+	__atomic_add_fetch( &histogram->count, 1, __ATOMIC_RELAXED );
+	max = __atomic_load_n( &histogram->maxns, __ATOMIC_RELAXED );
+	while ( ns > max && !__atomic_compare_exchange_n( &histogram->maxns, &max, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) );
+}
+
+/*
+ * Returns the latency below which permille thousandths of the commands
+ * counted in buckets fall, total of them, and none of which took longer
+ * than max.
+ */
+static uint64_t
+statspercentile( const uint64_t * buckets, uint64_t total, int permille, uint64_t max )
+{
+	uint64_t	target, seen;
+	int		i;
+
+	target = (total * permille + 999) / 1000;
+	for ( seen = 0, i = 0; i < STATS_BUCKETS - 1; i++ )
+	{
+		if ( (seen += buckets[i]) >= target )
+		{
+			break;
+		}
+	}
+	return statsvalue( i ) < max ? statsvalue( i ) : max;
+}
+
+/*
+ * Writes a table of the latencies of every command run so far.  Buckets
+ * are copied first, so a report taken while sessions run is consistent
+ * with itself if not with the counters.
+ *
+ * Returns the length of the report.
+ */
+int
+statsreport( char * buffer, size_t size )
+{
+	uint64_t	buckets[STATS_BUCKETS];
+	uint64_t	total, max;
+	double		seconds;
+	int		command, i, n;
+
+	if ( stats == NULL )
+	{
+		return snprintf(buffer, size, "No statistics.\n");
+	}
+	seconds = (statsnow() - stats->startns) / 1e9;
+	n = snprintf(buffer, size, "%-8s %10s %10s %10s %10s %10s %10s\n",
+		"command", "count", "ops/sec", "p50 us", "p99 us", "p99.9 us", "max us");
+	for ( command = 0; command < STATS_COMMANDS && n < (int) size; command++ )
+	{
+		for ( total = 0, i = 0; i < STATS_BUCKETS; i++ )
+		{
+			total += buckets[i] = __atomic_load_n( &stats->commands[command].buckets[i], __ATOMIC_RELAXED );
+		}
+		if ( total == 0 )
+		{
+			continue;
+		}
+		max = __atomic_load_n( &stats->commands[command].maxns, __ATOMIC_RELAXED );
+		n += snprintf(buffer + n, size - n, "%-8s %10llu %10.2f %10.1f %10.1f %10.1f %10.1f\n",
+			statsnames[command], (unsigned long long) total, total / seconds,
+			statspercentile( buckets, total, 500, max ) / 1e3, statspercentile( buckets, total, 990, max ) / 1e3,
+			statspercentile( buckets, total, 999, max ) / 1e3, max / 1e3);
+	}
+	return n < (int) size ? n : (int) size - 1;
+}
@@ -0,0 +1,85 @@
+#ifndef BANKSTATS_H
+#define BANKSTATS_H
+/*
+ * bankstats.h
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/mman.h>
+
+/*
+ * Each power of two of latency is split into 2^STATS_SUBBITS buckets, so a
+ * reported latency is within about 3% of the measured one.  Latencies of
+ * 2^STATS_MAXBITS nanoseconds (about 18 minutes) or more share the last
+ * bucket.
+ */
+#define STATS_SUBBITS		5
+#define STATS_SUBBUCKETS	(1 << STATS_SUBBITS)
+#define STATS_MAXBITS		40
+#define STATS_BUCKETS		((STATS_MAXBITS - STATS_SUBBITS + 1) * STATS_SUBBUCKETS)
+
+/*
+ * One histogram per COMMAND_ code.
+ */
+#define STATS_COMMANDS		(COMMAND_STATS + 1)
+
+/*
+ * Room needed for a report of every command.
+ */
+#define STATS_REPORTMAX		(80 * (STATS_COMMANDS + 2))
+
+/*
+ * Latency histogram of one command: the number of commands, their total
+ * and longest latency, and the number of commands per latency bucket, all
+ * in nanoseconds.
+ */
+struct StatsHistogram_ {
+	uint64_t		count;
+	uint64_t		totalns;
+	uint64_t		maxns;
+	uint64_t		buckets[STATS_BUCKETS];
+};
+typedef struct StatsHistogram_ StatsHistogram;
+
+/*
+ * Histograms of every command since startns.
+ */
+struct BankStats_ {
+	uint64_t		startns;
+	StatsHistogram		commands[STATS_COMMANDS];
+};
+typedef struct BankStats_ BankStats;
+
+/*
+ * Starts collecting latencies.  The histograms are shared with processes
+ * fork()ed afterwards, so every session adds to the same ones.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+statsinit( void );
+
+/*
+ * Returns the current time in nanoseconds, to be passed to statsrecord().
+ */
+uint64_t
+statsnow( void );
+
+/*
+ * Adds the latency of one command, of the given COMMAND_ code, that
+ * started at startns.  Lock free.  Does nothing before statsinit().
+ */
+void
+statsrecord( int command, uint64_t startns );
+
+/*
+ * Writes a table of the count, rate and p50, p99 and p99.9 latencies of
+ * every command run so far to buffer, which holds size bytes
+ * (STATS_REPORTMAX is enough).
+ *
+ * Returns the length of the report.
+ */
+int
+statsreport( char * buffer, size_t size );
+#endif
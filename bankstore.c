@@ -0,0 +1,397 @@
+/*
+ * bankstore.c
+ * Authors:	Emmanuel Baah
+ * 		Yuk Yan
+ *
+ * Layout of the bank in shared or mapped memory.  The Bank header is
+ * followed by a CRC32C per page of the rest of the bank, then by the name
+ * index and the name arena, sized for the maximum number of accounts, then
+ * by the account state records and finally by the accounts themselves.  Regions are found
+ * through offsets in the header rather than pointers, since every process
+ * attaches the bank at its own address.
+ *
+ * The state every transaction touches (balance, saved balance, snapshot
+ * version and flags) is kept in an array of AccountState records indexed
+ * by account ID, sized for the maximum number of accounts, while the
+ * Account structs hold only the locks and the offsets of the names.  The records are
+ * either dense, so a scan over every balance (reports, totals, snapshots)
+ * reads a few bytes per account, or padded to a cache line each, so no
+ * two accounts share a line.  The choice is made when the bank is created
+ * (-l) and recorded in the header.
+ *
+ * The header describes the format: a magic, a version, the size of an
+ * account and the offsets, covered by their own checksum, so an existing
+ * bank that does not match this build is refused rather than attached.
+ * The page checksums are only written when the bank is closed cleanly, and
+ * are verified when it is attached next.
+ *
+ * Only the first capacity accounts are backed by memory.  A bank that can
+ * grow (bankdata) is mapped for its maximum size up front, so extending
+ * the file is enough for every attached process to see the new accounts
+ * at the same address.
+ */
+#include "bankstore.h"
+
+#define BANK_ROUNDUP(x)		(((x) + BANK_ALIGN - 1) & ~((size_t) BANK_ALIGN - 1))
+#define BANK_PAGEUP(x)		(((x) + BANK_PAGE - 1) & ~((size_t) BANK_PAGE - 1))
+#define BANKCHECKSUMS(bank)	((uint32_t *) ((char *) (bank) + (bank)->checksumoffset))
+
+/*
+ * A range of pages verified by one thread.
+ */
+struct BankVerify_ {
+	Bank			* bank;
+	unsigned int		first;
+	unsigned int		last;
+	int			bad;
+};
+typedef struct BankVerify_ BankVerify;
+
+/*
+ * Returns the checksum of the format fields of the header.
+ */
+static uint32_t
+bankformatcrc( Bank * bank )
+{
+	uint32_t	crc;
+
+	crc = bankcrc( 0, bank->magic, sizeof(bank->magic) );
+	crc = bankcrc( crc, &bank->version, sizeof(bank->version) );
+	crc = bankcrc( crc, &bank->accountsize, sizeof(bank->accountsize) );
+	crc = bankcrc( crc, &bank->statesize, sizeof(bank->statesize) );
+	crc = bankcrc( crc, &bank->pagesize, sizeof(bank->pagesize) );
+	crc = bankcrc( crc, &bank->pages, sizeof(bank->pages) );
+	crc = bankcrc( crc, &bank->maxaccounts, sizeof(bank->maxaccounts) );
+	crc = bankcrc( crc, &bank->indexsize, sizeof(bank->indexsize) );
+	crc = bankcrc( crc, &bank->checksumoffset, sizeof(bank->checksumoffset) );
+	crc = bankcrc( crc, &bank->indexoffset, sizeof(bank->indexoffset) );
+	crc = bankcrc( crc, &bank->arenaoffset, sizeof(bank->arenaoffset) );
+	crc = bankcrc( crc, &bank->arenasize, sizeof(bank->arenasize) );
+	crc = bankcrc( crc, &bank->stateoffset, sizeof(bank->stateoffset) );
+	return bankcrc( crc, &bank->accountsoffset, sizeof(bank->accountsoffset) );
+}
+
+/*
+ * Lays out a bank able to hold up to maxaccounts accounts.  The index
+ * starts on a page so checksum pages match memory pages; the regions
+ * after it are placed relative to it first, since the size of the
+ * checksum table depends on them.
+ */
+void
+banklayout( Bank * bank, int maxaccounts, size_t statesize )
+{
+	size_t		max;
+
+	memcpy(bank->magic, BANK_MAGIC, sizeof(bank->magic));
+	bank->version = BANK_VERSION;
+	bank->accountsize = sizeof(Account);
+	bank->statesize = statesize;
+	bank->pagesize = BANK_PAGE;
+	bank->maxaccounts = maxaccounts;
+	for ( bank->indexsize = 16; bank->indexsize < 2 * (unsigned int) maxaccounts; bank->indexsize <<= 1 );
+	max = maxaccounts;
+	bank->arenaoffset = BANK_ROUNDUP(bank->indexsize * sizeof(uint64_t));
+	bank->arenasize = BANK_ROUNDUP(bankarena_reserve( maxaccounts ));
+	bank->stateoffset = bank->arenaoffset + bank->arenasize;
+	bank->accountsoffset = bank->stateoffset + BANK_ROUNDUP(max * statesize);
+	bank->pages = (bank->accountsoffset + max * sizeof(Account) + BANK_PAGE - 1) / BANK_PAGE;
+
+	bank->checksumoffset = BANK_ROUNDUP(sizeof(Bank));
+	bank->indexoffset = BANK_PAGEUP(bank->checksumoffset + bank->pages * sizeof(uint32_t));
+	bank->arenaoffset += bank->indexoffset;
+	bank->stateoffset += bank->indexoffset;
+	bank->accountsoffset += bank->indexoffset;
+	bank->formatcrc = bankformatcrc( bank );
+}
+
+/*
+ * Checks the header of an existing bank of size bytes.
+ *
+ * Returns 0 if the bank can be attached, -1 otherwise.
+ */
+int
+bankcheck( Bank * header, size_t size )
+{
+	Bank	layout;
+
+	if ( size < sizeof(Bank) || memcmp(header->magic, BANK_MAGIC, sizeof(header->magic)) != 0 )
+	{
+		errormessage("Not a bank: bad magic");
+		return -1;
+	}
+	else if ( header->version != BANK_VERSION )
+	{
+		errormessage("Unsupported bank format version");
+		return -1;
+	}
+	else if ( header->formatcrc != bankformatcrc( header ) )
+	{
+		errormessage("Bank header is corrupt");
+		return -1;
+	}
+	else if ( header->maxaccounts < 1 || header->accountsize != sizeof(Account) || header->pagesize != BANK_PAGE
+		|| (header->statesize != BANK_STATE_DENSE && header->statesize != BANK_STATE_PADDED) )
+	{
+		errormessage("Bank was written by an incompatible build");
+		return -1;
+	}
+	banklayout( &layout, header->maxaccounts, header->statesize );
+	if ( layout.indexsize != header->indexsize || layout.pages != header->pages
+		|| layout.checksumoffset != header->checksumoffset || layout.indexoffset != header->indexoffset
+		|| layout.arenaoffset != header->arenaoffset || layout.arenasize != header->arenasize
+		|| layout.stateoffset != header->stateoffset || layout.accountsoffset != header->accountsoffset )
+	{
+		errormessage("Bank layout does not match this build");
+		return -1;
+	}
+	else if ( header->capacity < 0 || header->capacity > header->maxaccounts || header->numaccounts < 0
+		|| header->numaccounts > header->capacity || header->arenaused > header->arenasize
+		|| size < bankbytes( header, header->capacity ) )
+	{
+		errormessage("Bank is truncated");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Returns the checksum of the given page of the index and the accounts,
+ * which end at end bytes from the start of the bank.
+ */
+static uint32_t
+bankpagecrc( Bank * bank, unsigned int page, size_t end )
+{
+	size_t		start;
+
+	start = bank->indexoffset + (size_t) page * BANK_PAGE;
+	return bankcrc( 0, (char *) bank + start, end - start < BANK_PAGE ? end - start : BANK_PAGE );
+}
+
+/*
+ * Returns the number of checksummed pages backed by memory.
+ */
+static unsigned int
+bankpages( Bank * bank )
+{
+	return (bankbytes( bank, bank->capacity ) - bank->indexoffset + BANK_PAGE - 1) / BANK_PAGE;
+}
+
+/*
+ * Writes the checksum of every page of the index and of the accounts.
+ */
+void
+bankstamp( Bank * bank )
+{
+	unsigned int	page, n;
+
+	for ( n = bankpages( bank ), page = 0; page < n; page++ )
+	{
+		BANKCHECKSUMS(bank)[page] = bankpagecrc( bank, page, bankbytes( bank, bank->capacity ) );
+	}
+}
+
+/*
+ * Verifies the page checksums of one range.
+ */
+static void *
+bankverifyrange( void * arg )
+{
+	BankVerify	* range;
+	unsigned int	page;
+
+	range = arg;
+	for ( page = range->first; page < range->last; page++ )
+	{
+		if ( BANKCHECKSUMS(range->bank)[page] != bankpagecrc( range->bank, page, bankbytes( range->bank, range->bank->capacity ) ) )
+		{
+			range->bad++;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Verifies every page checksum.  Banks of more than a few megabytes are
+ * split between up to BANK_VERIFY_THREADS threads.
+ *
+ * Returns the number of pages that do not match.
+ */
+int
+bankverify( Bank * bank )
+{
+	BankVerify	ranges[BANK_VERIFY_THREADS];
+	pthread_t	tids[BANK_VERIFY_THREADS];
+	unsigned int	pages;
+	int		i, n, bad;
+
+	pages = bankpages( bank );
+	if ( (n = sysconf(_SC_NPROCESSORS_ONLN)) > BANK_VERIFY_THREADS )
+	{
+		n = BANK_VERIFY_THREADS;
+	}
+	if ( n > (int) (pages / 1024) )
+	{
+		/* Not worth a thread below 4MB each */
+		n = pages / 1024;
+	}
+	n = n < 1 ? 1 : n;
+	for ( i = 0; i < n; i++ )
+	{
+		ranges[i].bank = bank;
+		ranges[i].first = (uint64_t) pages * i / n;
+		ranges[i].last = (uint64_t) pages * (i + 1) / n;
+		ranges[i].bad = 0;
+		if ( i > 0 && pthread_create( &tids[i], NULL, bankverifyrange, &ranges[i] ) != 0 )
+		{
+			/* Verify this range here instead */
+			tids[i] = 0;
+			bankverifyrange( &ranges[i] );
+		}
+	}
+	bankverifyrange( &ranges[0] );
+	for ( bad = ranges[0].bad, i = 1; i < n; i++ )
+	{
+		if ( tids[i] != 0 )
+		{
+			pthread_join( tids[i], NULL );
+		}
+		bad += ranges[i].bad;
+	}
+	return bad;
+}
+
+/*
+ * Returns the number of bytes from the start of the bank needed to hold
+ * the first capacity accounts.
+ */
+size_t
+bankbytes( Bank * bank, int capacity )
+{
+	return bank->accountsoffset + (size_t) capacity * sizeof(Account);
+}
+
+/*
+ * Returns the account with the given ID (or index).
+ */
+Account *
+bankaccount( Bank * bank, int id )
+{
+	return (Account *) ((char *) bank + bank->accountsoffset) + id;
+}
+
+/*
+ * Returns the hot state record of the account with the given ID.
+ */
+AccountState *
+bankstate( Bank * bank, int id )
+{
+	return (AccountState *) ((char *) bank + bank->stateoffset + (size_t) id * bank->statesize);
+}
+
+/*
+ * Returns the balance of the account with the given ID.
+ */
+int64_t *
+bankbalance( Bank * bank, int id )
+{
+	return &bankstate( bank, id )->balance;
+}
+
+/*
+ * Returns the saved balance of the account with the given ID.
+ */
+int64_t *
+banksaved( Bank * bank, int id )
+{
+	return &bankstate( bank, id )->saved;
+}
+
+/*
+ * Returns the snapshot epoch of the saved balance of the account with
+ * the given ID.
+ */
+uint32_t *
+bankversion( Bank * bank, int id )
+{
+	return &bankstate( bank, id )->version;
+}
+
+/*
+ * Returns the flags of the account with the given ID.
+ */
+uint8_t *
+bankflags( Bank * bank, int id )
+{
+	return &bankstate( bank, id )->flags;
+}
+
+/*
+ * Initializes the account with the given ID.  Its name is appended to the
+ * name arena.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+bankinitaccount( Bank * bank, int id, char * name )
+{
+	size_t		offset;
+
+	if ( bankarena_add( bank, name, &offset ) != 0 )
+	{
+		return -1;
+	}
+	memset(bankstate( bank, id ), 0, bank->statesize);
+	return accountinit( bankaccount( bank, id ), offset );
+}
+
+/*
+ * Initializes every lock of an attached or restored bank, ends the
+ * sessions it was left with and forgets saved balances.  The locks and
+ * session queues may have been held by processes that no longer exist, and
+ * their PIDs may since have been reused.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+bankrelock( Bank * bank )
+{
+	Account		* account;
+	int		i;
+
+	if ( banklock_init( &bank->bankmutex ) != 0 )
+	{
+		return -1;
+	}
+	for ( i = 0; i < bank->numaccounts; i++ )
+	{
+		account = bankaccount( bank, i );
+		*bankflags( bank, i ) = 0;
+		*bankversion( bank, i ) = 0;
+		if ( sessiongate_init( &account->clientsession ) != 0 )
+		{
+			return -1;
+		}
+	}
+	bank->snapepoch = 0;
+	return 0;
+}
+
+/*
+ * Returns the sum of the balances of all open accounts.  Only the state
+ * records are read.
+ */
+int64_t
+banktotal( Bank * bank )
+{
+	const char	* state;
+	int64_t		total;
+	int		i, n;
+
+	n = __atomic_load_n( &bank->numaccounts, __ATOMIC_ACQUIRE );
+	state = (const char *) bankstate( bank, 0 );
+	for ( total = 0, i = 0; i < n; i++, state += bank->statesize )
+	{
+		total += __atomic_load_n( &((const AccountState *) state)->balance, __ATOMIC_RELAXED );
+	}
+	return total;
+}
@@ -0,0 +1,172 @@
+#ifndef BANKSTORE_H
+#define BANKSTORE_H
+/*
+ * bankstore.h
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Default maximum number of accounts, see -c.
+ */
+#define BANK_DEFAULT_ACCOUNTS	20
+
+/*
+ * Number of accounts a new bankdata file starts with.  The file doubles
+ * from there up to the maximum.
+ */
+#define BANK_INITIAL_ACCOUNTS	64
+
+/*
+ * Size of a cache line.
+ */
+#define BANK_CACHELINE		64
+
+/*
+ * Alignment of every region of the bank.
+ */
+#define BANK_ALIGN		BANK_CACHELINE
+
+/*
+ * Format of the bank.  BANK_VERSION changes whenever the layout of the
+ * header, the index, the name arena or an account changes.
+ */
+#define BANK_MAGIC		"BANKDATA"
+#define BANK_VERSION		5
+
+/*
+ * The index and the accounts are checksummed in pages of this size.
+ */
+#define BANK_PAGE		4096
+
+/*
+ * States of a bank.  Only a bank closed by closemmBank() has valid page
+ * checksums.
+ */
+#define BANK_OPEN		0
+#define BANK_CLOSED		1
+
+/*
+ * Sizes of the AccountState records of a bank, see -l.  Dense records
+ * share cache lines and are cheapest to scan; padded records each have a
+ * cache line of their own.  bench contend compares updates of the two.
+ */
+#define BANK_STATE_DENSE	sizeof(AccountState)
+#define BANK_STATE_PADDED	BANK_CACHELINE
+
+/*
+ * Flags of an account, see bankflags().
+ */
+#define ACCOUNT_INSESSION	0x01
+
+/*
+ * Most threads used to verify the page checksums.
+ */
+#define BANK_VERIFY_THREADS	16
+
+struct Bank_;
+
+/*
+ * Lays out a bank able to hold up to maxaccounts accounts, with
+ * AccountState records of statesize bytes (BANK_STATE_DENSE or
+ * BANK_STATE_PADDED): the Bank header, the page checksums, the name
+ * index, the name arena, the state records, then the accounts.  Only the format and
+ * layout fields of the header are set.
+ */
+void
+banklayout( struct Bank_ * bank, int maxaccounts, size_t statesize );
+
+/*
+ * Checks the header of an existing bank of size bytes: its magic, version
+ * and header checksum, and that its layout is the one this build would
+ * use for its maximum number of accounts.
+ *
+ * Returns 0 if the bank can be attached, -1 otherwise.
+ */
+int
+bankcheck( struct Bank_ * header, size_t size );
+
+/*
+ * Writes the checksum of every page of the index and of the accounts.
+ */
+void
+bankstamp( struct Bank_ * bank );
+
+/*
+ * Verifies every page checksum, using several threads for large banks.
+ *
+ * Returns the number of pages that do not match.
+ */
+int
+bankverify( struct Bank_ * bank );
+
+/*
+ * Returns the number of bytes from the start of the bank needed to hold
+ * the first capacity accounts.
+ */
+size_t
+bankbytes( struct Bank_ * bank, int capacity );
+
+/*
+ * Returns the account with the given ID (or index).
+ */
+Account *
+bankaccount( struct Bank_ * bank, int id );
+
+/*
+ * Returns the hot state record of the account with the given ID.
+ */
+AccountState *
+bankstate( struct Bank_ * bank, int id );
+
+/*
+ * Returns the balance, in cents, of the account with the given ID.
+ */
+int64_t *
+bankbalance( struct Bank_ * bank, int id );
+
+/*
+ * Returns the balance of the account with the given ID saved for a
+ * running snapshot, see banksnapshot.c.
+ */
+int64_t *
+banksaved( struct Bank_ * bank, int id );
+
+/*
+ * Returns the snapshot epoch the saved balance of the account with the
+ * given ID belongs to.
+ */
+uint32_t *
+bankversion( struct Bank_ * bank, int id );
+
+/*
+ * Returns the ACCOUNT_ flags of the account with the given ID.
+ */
+uint8_t *
+bankflags( struct Bank_ * bank, int id );
+
+/*
+ * Initializes the account with the given ID: its name, appended to the
+ * name arena, its locks, a zero balance and no flags.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+bankinitaccount( struct Bank_ * bank, int id, char * name );
+
+/*
+ * Initializes every lock of a bank attached from a file or restored from
+ * a snapshot, ends every session on it (clearing ACCOUNT_INSESSION) and
+ * forgets saved balances.  Must be called before any session runs.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+bankrelock( struct Bank_ * bank );
+
+/*
+ * Returns the sum of the balances of all open accounts.
+ */
+int64_t
+banktotal( struct Bank_ * bank );
+#endif
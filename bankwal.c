@@ -0,0 +1,279 @@
+/*
+ * bankwal.c
+ * Authors:	Emmanuel Baah
+ * 		Yuk Yan
+ *
+ * Write-ahead log for the memory mapped bank.  Every open and every change
+ * of a balance is appended to the log before the client hears about it,
+ * and with DURABILITY_SYNC replies wait in walcommit() until the log is on
+ * disk.  bankdata
+ * itself is left to the page cache; on startup the log is replayed into it
+ * (see recovermmBank()) and emptied.
+ *
+ * Appends are serialized by the log mutex so records never interleave.
+ * Syncing is not: the first process to commit becomes the syncer, and
+ * everybody who appended while it was in fdatasync() is covered by the
+ * next sync, so many sessions share one disk flush.
+ */
+#include "bankwal.h"
+
+/*
+ * How long a commit waits for the syncer before checking that it is alive.
+ */
+#define WAL_WAIT_MS		10
+
+/*
+ * Holes are punched into the log in whole pages.
+ */
+#define WAL_PAGE		4096
+
+static int		walfd = -1;
+static BankWal		* wal;
+static uint64_t		walmine;	/* end of this process' last record */
+
+/*
+ * Returns the CRC32C of length bytes.
+ */
+static uint32_t
+walcrc( const void * data, size_t length )
+{
+	return bankcrc( 0, data, length );
+}
+
+/*
+ * Creates an empty log at path and initializes its shared state for the
+ * given durability level.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+walopen( const char * path, BankWal * shared, int durability )
+{
+	int	dirfd;
+
+	if ( (walfd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0666)) == -1 )
+	{
+		errormessage("open() failed");
+		return -1;
+	}
+	else if ( fsync(walfd) != 0 )
+	{
+		errormessage("fsync() failed");
+	}
+	else if ( (dirfd = open(".", O_RDONLY)) == -1 )
+	{
+		errormessage("open() failed");
+	}
+	else
+	{
+		/* Make sure the log itself survives a crash */
+		fsync(dirfd);
+		close(dirfd);
+		wal = shared;
+		wal->size = wal->synced = 0;
+		wal->syncer = 0;
+		wal->durability = durability;
+		if ( banklock_init( &wal->mutex ) == 0 && bankcond_init( &wal->cond ) == 0 )
+		{
+			return 0;
+		}
+		errormessage("Could not initialize log locks");
+	}
+	close(walfd);
+	walfd = -1;
+	return -1;
+}
+
+/*
+ * Returns the offset the next record will be appended at, 0 if no log is
+ * open.
+ */
+uint64_t
+walposition( void )
+{
+	uint64_t	position;
+
+	if ( walfd == -1 )
+	{
+		return 0;
+	}
+	banklock( &wal->mutex );
+	position = wal->size;
+	bankunlock( &wal->mutex );
+	return position;
+}
+
+/*
+ * Frees the disk space of the log before position by punching a hole in
+ * it.  File systems that cannot punch holes keep the space.
+ */
+void
+waldiscard( uint64_t position )
+{
+	position &= ~(uint64_t) (WAL_PAGE - 1);
+	if ( walfd != -1 && position > 0
+		&& fallocate(walfd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, position) != 0 && errno != EOPNOTSUPP )
+	{
+		errormessage("fallocate() failed");
+	}
+}
+
+/*
+ * Reads the next record of a log being replayed.
+ *
+ * Returns 1 if a record was read, 0 at the end of the log or at a torn or
+ * corrupt record.
+ */
+int
+walnext( FILE * log, WalRecord * record )
+{
+	if ( fread(record, WAL_HEADER, 1, log) != 1 )
+	{
+		return 0;
+	}
+	else if ( record->size < WAL_HEADER || record->size > sizeof(WalRecord) )
+	{
+		return 0;
+	}
+	else if ( record->size > WAL_HEADER && fread(record->name, record->size - WAL_HEADER, 1, log) != 1 )
+	{
+		return 0;
+	}
+	else if ( record->crc != walcrc( (char *) record + sizeof(record->crc), record->size - sizeof(record->crc) ) )
+	{
+		return 0;
+	}
+	record->name[sizeof(record->name) - 1] = '\0';
+	return 1;
+}
+
+/*
+ * Appends a record to the log.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+walappend( int type, int id, int64_t balance, const char * name )
+{
+	WalRecord	record;
+	int		rv;
+
+	if ( walfd == -1 || wal->durability == DURABILITY_MEMORY )
+	{
+		return 0;
+	}
+	bzero( &record, sizeof(record) );
+	record.type = type;
+	record.size = WAL_HEADER;
+	record.id = id;
+	record.balance = balance;
+	if ( type == WAL_OPEN )
+	{
+		strncpy( record.name, name, sizeof(record.name) - 1 );
+		record.size += (strlen(record.name) + 8) & ~7;
+	}
+	record.crc = walcrc( (char *) &record + sizeof(record.crc), record.size - sizeof(record.crc) );
+
+	banklock( &wal->mutex );
+	if ( write(walfd, &record, record.size) != record.size )
+	{
+		errormessage("Could not append to the log");
+		rv = -1;
+	}
+	else
+	{
+		walmine = wal->size += record.size;
+		rv = 0;
+	}
+	bankunlock( &wal->mutex );
+	return rv;
+}
+
+/*
+ * Waits until every record this process appended is on disk.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+walcommit( void )
+{
+	struct timespec		deadline;
+	uint64_t		target;
+	int			rv;
+
+	if ( walfd == -1 || wal->durability != DURABILITY_SYNC
+		|| __atomic_load_n( &wal->synced, __ATOMIC_ACQUIRE ) >= walmine )
+	{
+		return 0;
+	}
+	rv = 0;
+	banklock( &wal->mutex );
+	while ( rv == 0 && wal->synced < walmine )
+	{
+		if ( wal->syncer != 0 && kill(wal->syncer, 0) == 0 )
+		{
+			/* Somebody is syncing already, the next sync will cover us */
+			clock_gettime( CLOCK_MONOTONIC, &deadline );
+			if ( (deadline.tv_nsec += WAL_WAIT_MS * 1000000) >= 1000000000 )
+			{
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000;
+			}
+			bankcond_wait( &wal->cond, &wal->mutex, &deadline );
+			continue;
+		}
+		wal->syncer = getpid();
+		target = wal->size;
+		bankunlock( &wal->mutex );
+		if ( fdatasync(walfd) != 0 )
+		{
+			errormessage("fdatasync() failed");
+			rv = -1;
+		}
+		banklock( &wal->mutex );
+		if ( rv == 0 && target > wal->synced )
+		{
+			__atomic_store_n( &wal->synced, target, __ATOMIC_RELEASE );
+		}
+		wal->syncer = 0;
+		pthread_cond_broadcast( &wal->cond );
+	}
+	bankunlock( &wal->mutex );
+	return rv;
+}
+
+/*
+ * Syncs every record appended so far.  Unlike walcommit() this never
+ * waits for another syncer; overlapping syncs are harmless.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+walflush( void )
+{
+	uint64_t	target;
+
+	if ( walfd == -1 )
+	{
+		return 0;
+	}
+	banklock( &wal->mutex );
+	target = wal->size;
+	bankunlock( &wal->mutex );
+	if ( target <= __atomic_load_n( &wal->synced, __ATOMIC_ACQUIRE ) )
+	{
+		return 0;
+	}
+	else if ( fdatasync(walfd) != 0 )
+	{
+		errormessage("fdatasync() failed");
+		return -1;
+	}
+	banklock( &wal->mutex );
+	if ( target > wal->synced )
+	{
+		__atomic_store_n( &wal->synced, target, __ATOMIC_RELEASE );
+	}
+	bankunlock( &wal->mutex );
+	return 0;
+}
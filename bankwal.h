@@ -0,0 +1,133 @@
+#ifndef BANKWAL_H
+#define BANKWAL_H
+/*
+ * bankwal.h
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <sys/types.h>
+
+/*
+ * The write-ahead log of the memory mapped bank, next to bankdata.
+ */
+#define WAL_PATH		"bankwal"
+
+/*
+ * Record types.
+ */
+#define WAL_OPEN		1
+#define WAL_BALANCE		2
+
+/*
+ * One log record.  Records are written with only their first size bytes:
+ * WAL_HEADER for a balance, plus the NUL terminated name, rounded up to 8
+ * bytes, for an open.  balance is the account balance after the operation,
+ * so replaying a record twice is harmless.
+ */
+struct WalRecord_ {
+	uint32_t		crc;		/* CRC32C of the rest of the record */
+	uint16_t		type;
+	uint16_t		size;
+	int32_t			id;
+	uint32_t		reserved;
+	int64_t			balance;	/* cents */
+	char			name[104];
+};
+typedef struct WalRecord_ WalRecord;
+
+#define WAL_HEADER		offsetof(WalRecord, name)
+
+/*
+ * Durability levels.  With DURABILITY_SYNC a reply waits until its log
+ * record is on disk.  With DURABILITY_ASYNC it only waits for the record to
+ * be written; the background flusher syncs the log and the dirty pages of
+ * bankdata every few milliseconds.  With DURABILITY_MEMORY nothing is
+ * logged or synced and bankdata is left to the page cache.
+ */
+#define DURABILITY_SYNC		0
+#define DURABILITY_ASYNC	1
+#define DURABILITY_MEMORY	2
+
+/*
+ * State of the log shared by every server process, kept in the Bank
+ * header.  size is the number of bytes appended so far and synced the
+ * number known to be on disk.  syncer is the process running fdatasync()
+ * for everybody, 0 if none.  generation counts server starts; a log and
+ * the snapshots taken while it was written share a generation.
+ * durability is the level the log was opened with.
+ */
+struct BankWal_ {
+	pthread_mutex_t		mutex;
+	pthread_cond_t		cond;
+	uint64_t		size;
+	uint64_t		synced;
+	pid_t			syncer;
+	uint32_t		generation;
+	int			durability;
+};
+typedef struct BankWal_ BankWal;
+
+/*
+ * Creates an empty log at path, truncating any old one, and initializes
+ * its shared state for the given durability level.  Processes fork()ed
+ * afterwards log to it.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+walopen( const char * path, BankWal * shared, int durability );
+
+/*
+ * Returns the offset the next record will be appended at, 0 if no log is
+ * open.
+ */
+uint64_t
+walposition( void );
+
+/*
+ * Frees the disk space of the log before position, which must no longer be
+ * needed for recovery.  The log keeps its size and offsets.
+ */
+void
+waldiscard( uint64_t position );
+
+/*
+ * Reads the next record of a log being replayed.
+ *
+ * Returns 1 if a record was read, 0 at the end of the log or at a torn or
+ * corrupt record.
+ */
+int
+walnext( FILE * log, WalRecord * record );
+
+/*
+ * Appends a record to the log.  name is only used for WAL_OPEN.  Nothing
+ * is logged if no log is open or its durability is DURABILITY_MEMORY.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+walappend( int type, int id, int64_t balance, const char * name );
+
+/*
+ * Waits until every record this process appended is on disk.  One
+ * process syncs the log on behalf of all the others waiting, so
+ * concurrent sessions share a single fdatasync() (group commit).  Only
+ * DURABILITY_SYNC waits.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+walcommit( void );
+
+/*
+ * Syncs every record appended so far, for the background flusher.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+walflush( void );
+#endif